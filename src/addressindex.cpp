@@ -0,0 +1,55 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "pubkey.h"
+
+bool GetAddressIndexKey(const CTxDestination& dest, uint160& hashBytes, int& type)
+{
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_TYPE_PUBKEYHASH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_TYPE_SCRIPTHASH;
+        return true;
+    }
+    return false;
+}
+
+bool GetAddressIndexKey(const CScript& script, uint160& hashBytes, int& type)
+{
+    // Match the common templates directly, this runs for every output of every block
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22));
+        type = ADDRESS_TYPE_SCRIPTHASH;
+        return true;
+    }
+    if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+        type = ADDRESS_TYPE_PUBKEYHASH;
+        return true;
+    }
+
+    // Pay-to-pubkey (coinstake outputs) is indexed under the key's address
+    CTxDestination dest;
+    if (!ExtractDestination(script, dest))
+        return false;
+    return GetAddressIndexKey(dest, hashBytes, type);
+}
+
+CTxDestination GetAddressIndexDestination(const uint160& hashBytes, int type)
+{
+    switch (type) {
+    case ADDRESS_TYPE_PUBKEYHASH:
+        return CKeyID(hashBytes);
+    case ADDRESS_TYPE_SCRIPTHASH:
+        return CScriptID(hashBytes);
+    }
+    return CNoDestination();
+}
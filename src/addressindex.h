@@ -0,0 +1,236 @@
+// Copyright (c) 2016 BitPay, Inc.
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+/** Address types used in the keys of the address indexes (-addressindex) */
+enum AddressIndexType {
+    ADDRESS_TYPE_UNKNOWN = 0,
+    ADDRESS_TYPE_PUBKEYHASH = 1, //!< Hash160 of a public key, also used for pay-to-pubkey outputs
+    ADDRESS_TYPE_SCRIPTHASH = 2, //!< Hash160 of a redeem script
+};
+
+/** Map a destination to its address index type and hash; returns false if it has none */
+bool GetAddressIndexKey(const CTxDestination& dest, uint160& hashBytes, int& type);
+/** Map an output script to its address index type and hash; returns false if it has none */
+bool GetAddressIndexKey(const CScript& script, uint160& hashBytes, int& type);
+/** Inverse of GetAddressIndexKey */
+CTxDestination GetAddressIndexDestination(const uint160& hashBytes, int type);
+
+/**
+ * Address index entry: one for every output paying to an address and one for
+ * every input spending such an output (with a negative value).
+ * Keys sort by address, then by height and position in the block.
+ */
+struct CAddressIndexKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    CAddressIndexKey(int addressType, const uint160& addressHash, int height, unsigned int blockindex,
+        const uint256& txid, unsigned int indexValue, bool isSpending)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+        blockHeight = height;
+        txindex = blockindex;
+        txhash = txid;
+        index = indexValue;
+        spending = isSpending;
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_TYPE_UNKNOWN;
+        hashBytes.SetNull();
+        blockHeight = 0;
+        txindex = 0;
+        txhash.SetNull();
+        index = 0;
+        spending = false;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(BIGENDIAN32(blockHeight));
+        READWRITE(BIGENDIAN32(txindex));
+        READWRITE(txhash);
+        READWRITE(index);
+        READWRITE(spending);
+    }
+};
+
+/** Prefix of CAddressIndexKey used to seek to the first entry of an address (at or after a height) */
+struct CAddressIndexIteratorKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    bool fHeight;
+
+    CAddressIndexIteratorKey(int addressType, const uint160& addressHash)
+        : type(addressType), hashBytes(addressHash), blockHeight(0), fHeight(false) {}
+
+    CAddressIndexIteratorKey(int addressType, const uint160& addressHash, int height)
+        : type(addressType), hashBytes(addressHash), blockHeight(height), fHeight(true) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        if (fHeight)
+            READWRITE(BIGENDIAN32(blockHeight));
+    }
+};
+
+/** Unspent outputs of an address */
+struct CAddressUnspentKey {
+    unsigned char type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey()
+    {
+        SetNull();
+    }
+
+    CAddressUnspentKey(int addressType, const uint160& addressHash, const uint256& txid, unsigned int indexValue)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_TYPE_UNKNOWN;
+        hashBytes.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(txhash);
+        READWRITE(index);
+    }
+};
+
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    CAddressUnspentValue(CAmount sats, const CScript& scriptPubKey, int height)
+    {
+        satoshis = sats;
+        script = scriptPubKey;
+        blockHeight = height;
+    }
+
+    //! A null value marks the entry for deletion in CBlockTreeDB::UpdateAddressUnspentIndex
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return satoshis == -1;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+};
+
+/** Mempool counterpart of CAddressIndexKey */
+struct CMempoolAddressDeltaKey {
+    int type;
+    uint160 addressBytes;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CMempoolAddressDeltaKey(int addressType, const uint160& addressHash, const uint256& hash, unsigned int i, bool s)
+        : type(addressType), addressBytes(addressHash), txhash(hash), index(i), spending(s) {}
+
+    //! Lower bound of all entries of an address
+    CMempoolAddressDeltaKey(int addressType, const uint160& addressHash)
+        : type(addressType), addressBytes(addressHash), txhash(), index(0), spending(false) {}
+
+    bool operator<(const CMempoolAddressDeltaKey& b) const
+    {
+        if (type != b.type)
+            return type < b.type;
+        if (addressBytes != b.addressBytes)
+            return addressBytes < b.addressBytes;
+        if (txhash != b.txhash)
+            return txhash < b.txhash;
+        if (index != b.index)
+            return index < b.index;
+        return spending < b.spending;
+    }
+};
+
+struct CMempoolAddressDelta {
+    int64_t time;
+    CAmount amount;
+    uint256 prevhash;     //!< for spending entries: the output being spent
+    unsigned int prevout;
+
+    CMempoolAddressDelta(int64_t t, CAmount a, const uint256& hash, unsigned int out)
+        : time(t), amount(a), prevhash(hash), prevout(out) {}
+
+    CMempoolAddressDelta(int64_t t, CAmount a)
+        : time(t), amount(a), prevhash(), prevout(0) {}
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
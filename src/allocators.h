@@ -11,6 +11,7 @@
 #include <map>
 #include <string.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/thread/mutex.hpp>
@@ -258,6 +259,46 @@ struct zero_after_free_allocator : public std::allocator<T> {
     }
 };
 
+//
+// Allocator for buffers that hold no secrets and are written before they are
+// read: elements are default-initialized, so resizing a byte vector does not
+// zero-fill it, and nothing is cleared before deletion.
+//
+template <typename T>
+struct default_init_allocator : public std::allocator<T> {
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    default_init_allocator() throw() {}
+    default_init_allocator(const default_init_allocator& a) throw() : base(a) {}
+    template <typename U>
+    default_init_allocator(const default_init_allocator<U>& a) throw() : base(a)
+    {
+    }
+    ~default_init_allocator() throw() {}
+    template <typename _Other>
+    struct rebind {
+        typedef default_init_allocator<_Other> other;
+    };
+
+    template <typename U>
+    void construct(U* p)
+    {
+        ::new ((void*)p) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+};
+
 // This is exactly like std::string, but with a custom allocator.
 typedef std::basic_string<char, std::char_traits<char>, secure_allocator<char> > SecureString;
 
@@ -0,0 +1,158 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "util.h"
+
+#include <string.h>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileCache blockFileCache;
+
+CMappedBlockFile::CMappedBlockFile(const boost::filesystem::path& path, bool fFinalizedIn) : pdata(nullptr), nSize(0), fFinalized(fFinalizedIn)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            pdata = (const char*)p;
+            nSize = st.st_size;
+            if (fFinalized)
+                madvise(p, nSize, MADV_RANDOM);
+        } else {
+            LogPrintf("Unable to map file %s: %s\n", path.string(), strerror(errno));
+        }
+    }
+    close(fd);
+#endif
+}
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap((void*)pdata, nSize);
+#endif
+}
+
+void CMappedBlockFile::Prefetch(const char* pbegin, const char* pend) const
+{
+#ifndef WIN32
+    if (!fFinalized || pend <= pbegin)
+        return;
+    static const size_t nPageSize = sysconf(_SC_PAGESIZE);
+    size_t nOffset = (pbegin - pdata) % nPageSize;
+    madvise((void*)(pbegin - nOffset), (pend - pbegin) + nOffset, MADV_WILLNEED);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileCache::Get(int nFile, bool fUndo, size_t nMinSize)
+{
+    LOCK(cs);
+    FileKey key(nFile, fUndo);
+    std::map<FileKey, FileList::iterator>::iterator it = mapFiles.find(key);
+    if (it != mapFiles.end()) {
+        if (it->second->second->size() >= nMinSize) {
+            listFiles.splice(listFiles.begin(), listFiles, it->second);
+            return listFiles.front().second;
+        }
+        // The file grew since it was mapped
+        listFiles.erase(it->second);
+        mapFiles.erase(it);
+    }
+
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), fUndo ? "rev" : "blk");
+    std::shared_ptr<const CMappedBlockFile> file = std::make_shared<CMappedBlockFile>(path, nFile < nFirstOpenFile);
+    if (file->IsNull() || file->size() < nMinSize)
+        return nullptr;
+
+    listFiles.push_front(std::make_pair(key, file));
+    mapFiles[key] = listFiles.begin();
+    while (listFiles.size() > nMaxFiles) {
+        mapFiles.erase(listFiles.back().first);
+        listFiles.pop_back();
+    }
+    return file;
+}
+
+void CBlockFileCache::SetLastFile(int nFile)
+{
+    LOCK(cs);
+    int nFirst = std::min(nFile, nFirstOpenFile);
+    int nLast = std::max(nFile, nFirstOpenFile);
+    for (FileList::iterator it = listFiles.begin(); it != listFiles.end();) {
+        if (it->first.first >= nFirst && it->first.first < nLast) {
+            mapFiles.erase(it->first);
+            it = listFiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    nFirstOpenFile = nFile;
+}
+
+void CBlockFileCache::Remove(int nFile)
+{
+    LOCK(cs);
+    for (FileList::iterator it = listFiles.begin(); it != listFiles.end();) {
+        if (it->first.first == nFile) {
+            mapFiles.erase(it->first);
+            it = listFiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CBlockFileCache::Clear()
+{
+    LOCK(cs);
+    listFiles.clear();
+    mapFiles.clear();
+    nFirstOpenFile = 0;
+}
+
+bool CMappedBlockRecord::Open(const CDiskBlockPos& pos, bool fUndo, unsigned int nTrailer)
+{
+    // The record is preceded by the network magic and its size
+    if (pos.IsNull() || pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return false;
+    file = blockFileCache.Get(pos.nFile, fUndo, pos.nPos);
+    if (!file)
+        return false;
+    const char* pheader = file->begin() + pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int);
+    if (memcmp(pheader, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return false;
+    unsigned int nSize = ReadLE32((const unsigned char*)pheader + MESSAGE_START_SIZE);
+
+    size_t nEnd = (size_t)pos.nPos + nSize + nTrailer;
+    if (file->size() < nEnd) {
+        file = blockFileCache.Get(pos.nFile, fUndo, nEnd);
+        if (!file)
+            return false;
+    }
+    pbegin = file->begin() + pos.nPos;
+    pend = file->begin() + nEnd;
+    return true;
+}
+
+void CMappedBlockRecord::Prefetch() const
+{
+    if (file)
+        file->Prefetch(pbegin, pend);
+}
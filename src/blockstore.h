@@ -0,0 +1,211 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTORE_H
+#define BITCOIN_BLOCKSTORE_H
+
+#include "sync.h"
+
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
+
+class CBlockIndex;
+struct CDiskBlockPos;
+
+//! Maximum number of block and undo files kept mapped by the block file cache
+static const unsigned int MAX_MAPPED_BLOCK_FILES = sizeof(void*) > 4 ? 64 : 4;
+
+/** A read-only memory mapping of a whole blk?????.dat or rev?????.dat file */
+class CMappedBlockFile
+{
+private:
+    const char* pdata;
+    size_t nSize;
+    bool fFinalized;
+
+    // Disallow copies
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    //! Map the file; finalized files will not grow anymore and are only read at random positions
+    CMappedBlockFile(const boost::filesystem::path& path, bool fFinalized);
+    ~CMappedBlockFile();
+
+    bool IsNull() const { return pdata == nullptr; }
+    const char* begin() const { return pdata; }
+    size_t size() const { return nSize; }
+
+    //! Hint that a range is about to be read as a whole (finalized files are otherwise read without readahead)
+    void Prefetch(const char* pbegin, const char* pend) const;
+};
+
+/**
+ * LRU cache of mapped block and undo files, shared by all readers. Readers
+ * hold on to the mapping they got, so evicting or replacing an entry never
+ * invalidates a read in progress. Files that are still being appended to are
+ * mapped again once a read goes past the end of their current mapping.
+ */
+class CBlockFileCache
+{
+private:
+    typedef std::pair<int, bool> FileKey; //!< file number, undo file
+    typedef std::list<std::pair<FileKey, std::shared_ptr<const CMappedBlockFile> > > FileList;
+
+    CCriticalSection cs;
+    FileList listFiles; //!< most recently used first
+    std::map<FileKey, FileList::iterator> mapFiles;
+    int nFirstOpenFile; //!< files below this one are finalized
+    size_t nMaxFiles;
+
+public:
+    CBlockFileCache(size_t nMaxFilesIn = MAX_MAPPED_BLOCK_FILES) : nFirstOpenFile(0), nMaxFiles(nMaxFilesIn) {}
+
+    //! Get a mapping of a block (or undo) file that covers at least its first nMinSize bytes
+    std::shared_ptr<const CMappedBlockFile> Get(int nFile, bool fUndo, size_t nMinSize);
+
+    //! Mark the files below nFile as finalized, dropping mappings made while they were still written to
+    void SetLastFile(int nFile);
+
+    //! Drop the mappings of a block file and its undo file before they are deleted
+    void Remove(int nFile);
+
+    void Clear();
+};
+
+extern CBlockFileCache blockFileCache;
+
+/**
+ * A block or undo record in a mapped file, as written by WriteBlockToDisk and
+ * CBlockUndo::WriteToDisk: the serialized data is preceded by the network
+ * magic and its size.
+ */
+class CMappedBlockRecord
+{
+private:
+    std::shared_ptr<const CMappedBlockFile> file;
+    const char* pbegin;
+    const char* pend;
+
+public:
+    CMappedBlockRecord() : pbegin(nullptr), pend(nullptr) {}
+
+    //! Map the record at pos, including nTrailer bytes stored after it (the undo checksum)
+    bool Open(const CDiskBlockPos& pos, bool fUndo, unsigned int nTrailer = 0);
+
+    //! Hint that the whole record is about to be read
+    void Prefetch() const;
+
+    const char* begin() const { return pbegin; }
+    const char* end() const { return pend; }
+};
+
+/**
+ * Reads a list of blocks on worker threads and hands the results out in the
+ * order of the list. What is read for a block, and any checks done on it
+ * that don't need the caller's locks, is up to the read function. At most
+ * nAhead results are kept ahead of the one the caller is waiting for.
+ */
+template <typename T>
+class CBlockReadAhead
+{
+public:
+    //! Read the item for a block; on failure strError says what went wrong
+    typedef std::function<bool(const CBlockIndex* pindex, T& item, std::string& strError)> ReadFn;
+
+private:
+    struct Slot {
+        T item;
+        std::string strError;
+        bool fReady;
+    };
+
+    const std::vector<CBlockIndex*>& vBlocks;
+    ReadFn read;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<Slot> vSlots;
+    size_t nNextRead;
+    size_t nNextTaken;
+    bool fStop;
+    boost::thread_group workers;
+
+    void Worker()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true) {
+            while (!fStop && nNextRead < vBlocks.size() && nNextRead >= nNextTaken + vSlots.size())
+                cond.wait(lock);
+            if (fStop || nNextRead >= vBlocks.size())
+                return;
+            size_t nIndex = nNextRead++;
+            lock.unlock();
+            T item;
+            std::string strError;
+            try {
+                if (!read(vBlocks[nIndex], item, strError) && strError.empty())
+                    strError = "read failed";
+            } catch (const std::exception& e) {
+                strError = e.what();
+            }
+            lock.lock();
+            Slot& slot = vSlots[nIndex % vSlots.size()];
+            slot.item = std::move(item);
+            slot.strError = strError;
+            slot.fReady = true;
+            cond.notify_all();
+        }
+    }
+
+    // Disallow copies
+    CBlockReadAhead(const CBlockReadAhead&);
+    CBlockReadAhead& operator=(const CBlockReadAhead&);
+
+public:
+    CBlockReadAhead(const std::vector<CBlockIndex*>& vBlocksIn, const ReadFn& readIn, int nThreads, size_t nAhead) : vBlocks(vBlocksIn), read(readIn), vSlots(std::max(std::min(nAhead, vBlocksIn.size()), (size_t)1)), nNextRead(0), nNextTaken(0), fStop(false)
+    {
+        for (Slot& slot : vSlots)
+            slot.fReady = false;
+        for (int i = 0; i < std::max(nThreads, 1); i++)
+            workers.create_thread(boost::bind(&CBlockReadAhead::Worker, this));
+    }
+
+    ~CBlockReadAhead()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+            cond.notify_all();
+        }
+        workers.join_all();
+    }
+
+    //! Wait for the item of the next block in the list; returns false with the error in strError
+    bool Next(T& item, std::string& strError)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        Slot& slot = vSlots[nNextTaken % vSlots.size()];
+        while (!slot.fReady)
+            cond.wait(lock);
+        item = std::move(slot.item);
+        strError = slot.strError;
+        slot.fReady = false;
+        nNextTaken++;
+        cond.notify_all();
+        return strError.empty();
+    }
+};
+
+#endif // BITCOIN_BLOCKSTORE_H
@@ -61,19 +61,90 @@ const CBlockIndex* CChain::FindFork(const CBlockIndex* pindex) const
     return pindex;
 }
 
-uint256 CBlockIndex::GetBlockTrust() const
+
+/**
+ * CBlockIndexMap implementation
+ */
+size_t CBlockIndexMap::FindSlot(const uint256& hash) const
+{
+    size_t nMask = vSlots.size() - 1;
+    size_t nSlot = hash.GetCheapHash() & nMask;
+    while (vSlots[nSlot] && vSlots[nSlot]->hashBlock != hash)
+        nSlot = (nSlot + 1) & nMask;
+    return nSlot;
+}
+
+void CBlockIndexMap::Rehash(size_t nSlots)
+{
+    vector<CBlockIndex*> vOld(nSlots, nullptr);
+    vSlots.swap(vOld);
+    for (CBlockIndex* pindex : vOld) {
+        if (pindex)
+            vSlots[FindSlot(pindex->hashBlock)] = pindex;
+    }
+}
+
+CBlockIndexMap::iterator CBlockIndexMap::find(const uint256& hash) const
+{
+    if (vSlots.empty())
+        return end();
+    size_t nSlot = FindSlot(hash);
+    if (!vSlots[nSlot])
+        return end();
+    return iterator(vSlots.data() + nSlot, vSlots.data() + vSlots.size());
+}
+
+CBlockIndex* CBlockIndexMap::operator[](const uint256& hash) const
+{
+    if (vSlots.empty())
+        return nullptr;
+    return vSlots[FindSlot(hash)];
+}
+
+CBlockIndex* CBlockIndexMap::Allocate()
+{
+    if (vSlabs.empty() || nSlabUsed == SLAB_SIZE) {
+        vSlabs.emplace_back(new CBlockIndex[SLAB_SIZE]);
+        nSlabUsed = 0;
+    }
+    return &vSlabs.back()[nSlabUsed++];
+}
+
+pair<CBlockIndexMap::iterator, bool> CBlockIndexMap::insert(const uint256& hash, CBlockIndex* pindex)
 {
-    uint256 bnTarget;
-    bnTarget.SetCompact(nBits);
-    if (bnTarget <= 0)
-        return 0;
-
-    if (IsProofOfStake()) {
-        // Return trust score as usual
-        return (uint256(1) << 256) / (bnTarget + 1);
-    } else {
-        // Calculate work amount for block
-        uint256 bnPoWTrust = ((~uint256(0) >> 20) / (bnTarget + 1));
-        return bnPoWTrust > 1 ? bnPoWTrust : 1;
+    // Keep the table at most 3/4 full
+    if ((nSize + 1) * 4 > vSlots.size() * 3)
+        Rehash(max(vSlots.size() * 2, (size_t)1024));
+    size_t nSlot = FindSlot(hash);
+    bool fInserted = !vSlots[nSlot];
+    if (fInserted) {
+        pindex->hashBlock = hash;
+        pindex->phashBlock = &pindex->hashBlock;
+        vSlots[nSlot] = pindex;
+        nSize++;
     }
-}
\ No newline at end of file
+    return make_pair(iterator(vSlots.data() + nSlot, vSlots.data() + vSlots.size()), fInserted);
+}
+
+void CBlockIndexMap::reserve(size_t nEntries)
+{
+    size_t nSlots = max(vSlots.size(), (size_t)1024);
+    while (nEntries * 4 > nSlots * 3)
+        nSlots *= 2;
+    if (nSlots != vSlots.size())
+        Rehash(nSlots);
+    vSlabs.reserve((nEntries + SLAB_SIZE - 1) / SLAB_SIZE);
+}
+
+void CBlockIndexMap::clear()
+{
+    vector<CBlockIndex*>().swap(vSlots);
+    vSlabs.clear();
+    nSize = 0;
+    nSlabUsed = 0;
+}
+
+size_t CBlockIndexMap::DynamicMemoryUsage() const
+{
+    return vSlots.capacity() * sizeof(CBlockIndex*) + vSlabs.size() * SLAB_SIZE * sizeof(CBlockIndex);
+}
@@ -14,6 +14,8 @@
 #include "uint256.h"
 #include "util.h"
 
+#include <iterator>
+#include <memory>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -108,20 +110,17 @@ enum BlockStatus {
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. memory is owned by this CBlockIndex
+    //! pointer to the hash of the block, if any. points to hashBlock for entries of mapBlockIndex
     const uint256* phashBlock;
 
     //! pointer to the index of the predecessor of this block
     CBlockIndex* pprev;
 
-    //! pointer to the index of the next block
-    CBlockIndex* pnext;
-
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
-    //ppcoin: trust score of block chain
-    uint256 bnChainTrust;
+    //! hash of the block, set by CBlockIndexMap::insert
+    uint256 hashBlock;
 
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
@@ -158,12 +157,10 @@ public:
     };
 
     // proof-of-stake specific fields
-    uint256 GetBlockTrust() const;
     uint64_t nStakeModifier;             // hash modifier for proof-of-stake
     unsigned int nStakeModifierChecksum; // checksum of index; in-memeory only
     COutPoint prevoutStake;
     unsigned int nStakeTime;
-    uint256 hashProofOfStake;
     int64_t nMint;
     int64_t nMoneySupply;
 
@@ -182,6 +179,7 @@ public:
         phashBlock = nullptr;
         pprev = nullptr;
         pskip = nullptr;
+        hashBlock = uint256();
         nHeight = 0;
         nFile = 0;
         nDataPos = 0;
@@ -223,17 +221,15 @@ public:
         nNonce = block.nNonce;
 
         //Proof of Stake
-        bnChainTrust = uint256();
         nMint = 0;
         nMoneySupply = 0;
         nFlags = 0;
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
-        hashProofOfStake = uint256();
 
         if (block.IsProofOfStake()) {
             SetProofOfStake();
-            prevoutStake = block.vtx[1].vin[0].prevout;
+            prevoutStake = block.vtx[1]->vin[0].prevout;
             nStakeTime = block.nTime;
         } else {
             prevoutStake.SetNull();
@@ -437,7 +433,6 @@ public:
         } else {
             const_cast<CDiskBlockIndex*>(this)->prevoutStake.SetNull();
             const_cast<CDiskBlockIndex*>(this)->nStakeTime = 0;
-            const_cast<CDiskBlockIndex*>(this)->hashProofOfStake = uint256();
         }
 
         // block header
@@ -474,6 +469,113 @@ public:
     }
 };
 
+/**
+ * All known block index entries by block hash (mapBlockIndex).
+ *
+ * Entries are allocated in slabs owned by the map and are only released all
+ * at once by clear(), so pointers to them stay valid until then. Lookups use
+ * open addressing with linear probing over a flat array of entry pointers;
+ * the key is the hash stored in the entry itself, so the table costs a
+ * pointer per slot instead of a heap node per entry.
+ */
+class CBlockIndexMap
+{
+public:
+    //! What iterators point to; has the members of the std::pair of a node based map
+    struct value_type {
+        const uint256& first;
+        CBlockIndex* second;
+
+        explicit value_type(CBlockIndex* pindex) : first(pindex->hashBlock), second(pindex) {}
+    };
+
+    class iterator
+    {
+    private:
+        CBlockIndex* const* pslot;
+        CBlockIndex* const* pend;
+
+        void SkipEmpty()
+        {
+            while (pslot != pend && *pslot == nullptr)
+                pslot++;
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef CBlockIndexMap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type reference;
+
+        struct pointer {
+            value_type value;
+            explicit pointer(CBlockIndex* pindex) : value(pindex) {}
+            const value_type* operator->() const { return &value; }
+        };
+
+        iterator() : pslot(nullptr), pend(nullptr) {}
+        iterator(CBlockIndex* const* pslotIn, CBlockIndex* const* pendIn) : pslot(pslotIn), pend(pendIn) { SkipEmpty(); }
+
+        reference operator*() const { return value_type(*pslot); }
+        pointer operator->() const { return pointer(*pslot); }
+        iterator& operator++()
+        {
+            pslot++;
+            SkipEmpty();
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            iterator copy(*this);
+            ++(*this);
+            return copy;
+        }
+        bool operator==(const iterator& other) const { return pslot == other.pslot; }
+        bool operator!=(const iterator& other) const { return pslot != other.pslot; }
+    };
+    typedef iterator const_iterator;
+
+private:
+    //! Number of entries allocated at once
+    static const size_t SLAB_SIZE = 4096;
+
+    std::vector<CBlockIndex*> vSlots; //!< power of two sized, nullptr for empty slots
+    size_t nSize;
+    std::vector<std::unique_ptr<CBlockIndex[]> > vSlabs;
+    size_t nSlabUsed; //!< entries handed out from the last slab
+
+    // Disallow copies
+    CBlockIndexMap(const CBlockIndexMap&);
+    CBlockIndexMap& operator=(const CBlockIndexMap&);
+
+    //! The slot holding hash, or the empty slot where it would be inserted
+    size_t FindSlot(const uint256& hash) const;
+    void Rehash(size_t nSlots);
+
+public:
+    CBlockIndexMap() : nSize(0), nSlabUsed(0) {}
+
+    iterator begin() const { return iterator(vSlots.data(), vSlots.data() + vSlots.size()); }
+    iterator end() const { return iterator(vSlots.data() + vSlots.size(), vSlots.data() + vSlots.size()); }
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const uint256& hash) const;
+    size_t count(const uint256& hash) const { return find(hash) != end(); }
+    //! Look up an entry; unlike std::map this returns nullptr and inserts nothing if it is missing
+    CBlockIndex* operator[](const uint256& hash) const;
+
+    //! Get a new default constructed entry, to be passed to insert
+    CBlockIndex* Allocate();
+    //! Insert an entry from Allocate under hash, which is stored in the entry. Does nothing if hash is already present
+    std::pair<iterator, bool> insert(const uint256& hash, CBlockIndex* pindex);
+
+    void reserve(size_t nEntries);
+    //! Remove and free all entries
+    void clear();
+    size_t DynamicMemoryUsage() const;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
@@ -144,7 +144,7 @@ public:
         txNew.vin[0].scriptSig = CScript() << 486604799 << CScriptNum(4) << vector<unsigned char>((const unsigned char*)pszTimestamp, (const unsigned char*)pszTimestamp + strlen(pszTimestamp));
         txNew.vout[0].nValue = 0 * COIN;
         txNew.vout[0].scriptPubKey = CScript() << ParseHex("04e5a8143f86ad8ac63791fbbdb8e0b91a8da88c8c693a95f6c2c13c063ea790f7960b8025a9047a7bc671d5cfe707a2dd2e13b86182e1064a0eea7bf863636363") << OP_CHECKSIG;
-        genesis.vtx.push_back(txNew);
+        genesis.vtx.push_back(MakeTransactionRef(txNew));
         genesis.hashPrevBlock.SetNull();
         genesis.hashMerkleRoot = genesis.BuildMerkleTree();
         genesis.nVersion = 1;
@@ -156,6 +156,9 @@ public:
         assert(hashGenesisBlock == uint256S("0x000008467c3a9c587533dea06ad9380cded3ed32f9742a6c0c1aebc21bf2bc9b"));
         assert(genesis.hashMerkleRoot == uint256S("0x07cbcacfc822fba6bbeb05312258fa43b96a68fc310af8dfcec604591763f7cf"));
 
+        // The last checkpoint
+        defaultAssumeValid = uint256S("0x84351f1c1767f382715465b3ff2343d2644485171c29639701f33fee513db67f");
+
         // DNS Seeding
         vSeeds.push_back(CDNSSeedData("seed1.bitg.org", "seed1.bitg.org"));
         vSeeds.push_back(CDNSSeedData("seed2.bitg.org", "seed2.bitg.org"));
@@ -235,6 +238,7 @@ public:
 
         hashGenesisBlock = genesis.GetHash();
         assert(hashGenesisBlock == uint256S("0x000000938f4f20c6ccb3fea36539ade5af73d0bb45c55af64c7f7f1bfa5f3381"));
+        defaultAssumeValid = uint256();
 
         vFixedSeeds.clear();
         vSeeds.clear();
@@ -308,6 +312,7 @@ public:
         hashGenesisBlock = genesis.GetHash();
         nDefaultPort = 29333;
         assert(hashGenesisBlock == uint256S("0x229874aa8a92df3347600978e226ba57bc994b9fa291ea50519afafca2d50ed3"));
+        defaultAssumeValid = uint256();
 
         vFixedSeeds.clear(); //! Regtest mode doesn't have any fixed seeds.
         vSeeds.clear();      //! Regtest mode doesn't have any DNS seeds.
@@ -47,6 +47,8 @@ public:
     };
 
     const uint256& HashGenesisBlock() const { return hashGenesisBlock; }
+    /** Default value for -assumevalid, see the checkpoints for the criteria a block should meet */
+    const uint256& DefaultAssumeValid() const { return defaultAssumeValid; }
     const MessageStartChars& MessageStart() const { return pchMessageStart; }
     const std::vector<unsigned char>& AlertKey() const { return vAlertPubKey; }
     int GetDefaultPort() const { return nDefaultPort; }
@@ -103,6 +105,7 @@ protected:
     CChainParams() {}
 
     uint256 hashGenesisBlock;
+    uint256 defaultAssumeValid;
     MessageStartChars pchMessageStart;
     //! Raw pub key bytes for the broadcast alert signing key.
     std::vector<unsigned char> vAlertPubKey;
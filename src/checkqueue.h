@@ -6,6 +6,9 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -16,7 +19,27 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/** Time the threads of a check queue spent not running checks during one round of work */
+struct CCheckQueueStats {
+    //! Time the master waited for the workers to finish the last checks
+    int64_t nWaitMicros;
+    //! Time workers waited for checks to be added
+    int64_t nIdleMicros;
+    //! Time spent taking checks from the queues of other threads
+    int64_t nStealMicros;
+    //! Number of batches taken from the queue of another thread
+    unsigned int nSteals;
+    //! Number of batches taken, and the checks they held
+    unsigned int nBatches;
+    unsigned int nBatchChecks;
+    //! Sizes of the smallest and the largest batch taken
+    unsigned int nMinBatch;
+    unsigned int nMaxBatch;
+
+    CCheckQueueStats() : nWaitMicros(0), nIdleMicros(0), nStealMicros(0), nSteals(0), nBatches(0), nBatchChecks(0), nMinBatch(0), nMaxBatch(0) {}
+};
+
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -25,12 +48,34 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread has its own deque of verifications. The master hands each
+  * added batch to the next worker's deque; a worker takes from the back of
+  * its own deque and, once that is empty, steals from the front of another
+  * one. The shared mutex is only taken to sleep and to wake threads.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Verifications handed to one thread, behind their own lock
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+        //! Size of checks, readable without the lock to skip empty queues
+        std::atomic<unsigned int> nSize;
+        //! Whether a worker thread owns this queue; queue 0 is the master's
+        std::atomic<bool> fActive;
+        //! When the owner went to sleep waiting for work, or 0 (protected by CCheckQueue::mutex)
+        int64_t nIdleSince;
+
+        WorkerQueue() : nSize(0), fActive(false), nIdleSince(0) {}
+    };
+
+    //! Amount of work a batch should hold once the cost of a check is known, in nanoseconds
+    static const int64_t BATCH_NANOS = 1000000;
+
+    //! Mutex to sleep and wake threads, and to protect the statistics
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,122 +84,304 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The queues of the master (first) and the workers
+    std::vector<WorkerQueue> vQueues;
 
-    //! The total number of workers (including the master).
-    int nTotal;
-
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! Number of verifications in the queues, not taken by any thread yet
+    std::atomic<unsigned int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
-     * worker's own batches.
+     * This includes elements that are not anymore in a queue, but still in
+     * a thread's own batch.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    //! The number of workers that are asleep (protected by mutex)
+    int nIdle;
+
+    //! The queue the next added batch goes to (used by the master only)
+    size_t nNextQueue;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Moving average of the time one verification takes, in nanoseconds
+    std::atomic<int64_t> nCheckNanos;
+
+    //! When the current round of work started, or 0 (protected by mutex)
+    int64_t nStartTime;
+
+    //! Statistics of the current round (wait and idle time protected by mutex)
+    CCheckQueueStats stats;
+    std::atomic<int64_t> nStealMicros;
+    std::atomic<unsigned int> nSteals;
+    std::atomic<unsigned int> nBatches;
+    std::atomic<unsigned int> nBatchChecks;
+    std::atomic<unsigned int> nMinBatch;
+    std::atomic<unsigned int> nMaxBatch;
+
+    //! Monotonic time, cheap enough to read around every batch
+    static int64_t NowMicros()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Decide how many work units to take at once: enough for about BATCH_NANOS
+     * of work, but never more than nBatchSize, and at most half of what is
+     * available, so others can take the rest and all threads finish at about
+     * the same time.
+     */
+    size_t BatchSize(size_t nAvailable) const
+    {
+        size_t nMax = nBatchSize;
+        int64_t nCost = nCheckNanos.load(std::memory_order_relaxed);
+        if (nCost > 0)
+            nMax = std::max<size_t>(1, std::min<size_t>(nMax, BATCH_NANOS / nCost));
+        return std::max<size_t>(1, std::min(nMax, (nAvailable + 1) / 2));
+    }
+
+    //! Add a batch that was taken to the statistics
+    void CountBatch(unsigned int nSize)
+    {
+        nBatches++;
+        nBatchChecks += nSize;
+        unsigned int nCur = nMinBatch.load(std::memory_order_relaxed);
+        while ((nCur == 0 || nSize < nCur) && !nMinBatch.compare_exchange_weak(nCur, nSize)) {}
+        nCur = nMaxBatch.load(std::memory_order_relaxed);
+        while (nSize > nCur && !nMaxBatch.compare_exchange_weak(nCur, nSize)) {}
+    }
+
+    //! Move a batch from the back (own queue) or the front (stolen) of a queue into vChecks
+    bool TakeFrom(WorkerQueue& queue, std::vector<T>& vChecks, bool fFront)
+    {
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        if (queue.checks.empty())
+            return false;
+        size_t nNow = BatchSize(queue.checks.size());
+        vChecks.resize(nNow);
+        for (size_t i = 0; i < nNow; i++) {
+            // Swap jobs into the local batch vector instead of copying them
+            if (fFront) {
+                vChecks[i].swap(queue.checks.front());
+                queue.checks.pop_front();
+            } else {
+                vChecks[i].swap(queue.checks.back());
+                queue.checks.pop_back();
+            }
+        }
+        queue.nSize = queue.checks.size();
+        nQueued -= nNow;
+        CountBatch(nNow);
+        return true;
+    }
+
+    //! Take a batch from the own queue, or else steal one from another thread's
+    bool TakeBatch(size_t nSelf, std::vector<T>& vChecks)
+    {
+        if (vQueues[nSelf].nSize.load(std::memory_order_relaxed) && TakeFrom(vQueues[nSelf], vChecks, false))
+            return true;
+        if (nQueued == 0)
+            return false;
+        int64_t nStart = NowMicros();
+        bool fStolen = false;
+        for (size_t i = 1; i < vQueues.size() && !fStolen; i++) {
+            WorkerQueue& victim = vQueues[(nSelf + i) % vQueues.size()];
+            if (victim.nSize.load(std::memory_order_relaxed))
+                fStolen = TakeFrom(victim, vChecks, true);
+        }
+        nStealMicros += NowMicros() - nStart;
+        if (fStolen)
+            nSteals++;
+        return fStolen;
+    }
+
+    //! Execute a batch, and record its result and its cost
+    void RunBatch(std::vector<T>& vChecks)
+    {
+        // Check whether we need to do work at all
+        bool fOk = fAllOk;
+        if (fOk) {
+            int64_t nStart = NowMicros();
+            BOOST_FOREACH (T& check, vChecks)
+                if (fOk)
+                    fOk = check();
+            int64_t nCost = (NowMicros() - nStart) * 1000 / vChecks.size();
+            int64_t nAverage = nCheckNanos.load(std::memory_order_relaxed);
+            nCheckNanos.store(nAverage ? nAverage + (nCost - nAverage) / 8 : std::max<int64_t>(nCost, 1), std::memory_order_relaxed);
+            if (!fOk)
+                fAllOk = false;
+        }
+        unsigned int nNow = vChecks.size();
+        vChecks.clear();
+        if (nTodo.fetch_sub(nNow) == nNow) {
+            // We processed the last element; inform the master he can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
+    //! Add the time a worker slept during the current round to the statistics (requires mutex)
+    void AddIdleTime(WorkerQueue& queue, int64_t nNow)
+    {
+        if (nStartTime && queue.nIdleSince)
+            stats.nIdleMicros += nNow - std::max(queue.nIdleSince, nStartTime);
+    }
+
+    //! Claim a queue for a new worker thread
+    size_t Register()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (size_t i = 1; i < vQueues.size(); i++) {
+            if (!vQueues[i].fActive) {
+                vQueues[i].fActive = true;
+                return i;
+            }
+        }
+        // More workers than queues: share one, the queue is locked anyway
+        return vQueues.size() - 1;
+    }
+
+    void Unregister(size_t nSelf)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (vQueues[nSelf].nIdleSince)
+            nIdle--;
+        vQueues[nSelf].fActive = false;
+        vQueues[nSelf].nIdleSince = 0;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(size_t nSelf)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        bool fMaster = nSelf == 0;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+            if (TakeBatch(nSelf, vChecks)) {
+                RunBatch(vChecks);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nQueued != 0)
+                continue;
+            if (fMaster) {
+                // Nothing left to take: wait for the workers to finish what they took
+                int64_t nWaitStart = NowMicros();
+                while (nTodo != 0)
+                    condMaster.wait(lock);
+                int64_t nNow = NowMicros();
+                stats.nWaitMicros += nNow - nWaitStart;
+                for (size_t i = 1; i < vQueues.size(); i++) {
+                    AddIdleTime(vQueues[i], nNow);
+                    if (vQueues[i].nIdleSince)
+                        vQueues[i].nIdleSince = nNow;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                stats.nStealMicros = nStealMicros;
+                stats.nSteals = nSteals;
+                stats.nBatches = nBatches;
+                stats.nBatchChecks = nBatchChecks;
+                stats.nMinBatch = nMinBatch;
+                stats.nMaxBatch = nMaxBatch;
+                nStartTime = 0;
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            WorkerQueue& queue = vQueues[nSelf];
+            queue.nIdleSince = NowMicros();
+            nIdle++;
+            while (nQueued == 0)
+                condWorker.wait(lock); // wait
+            nIdle--;
+            AddIdleTime(queue, NowMicros());
+            queue.nIdleSince = 0;
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue for a master and at most nMaxWorkers worker threads
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkers) : vQueues(nMaxWorkers + 1), nQueued(0), nTodo(0), fAllOk(true), nIdle(0), nNextQueue(0),
+                                                                       nBatchSize(nBatchSizeIn), nCheckNanos(0), nStartTime(0), nStealMicros(0), nSteals(0),
+                                                                       nBatches(0), nBatchChecks(0), nMinBatch(0), nMaxBatch(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        size_t nSelf = Register();
+        try {
+            Loop(nSelf);
+        } catch (...) {
+            // Interrupted at shutdown: whatever is left in our queue is taken by the others
+            Unregister(nSelf);
+            throw;
+        }
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0);
+    }
+
+    //! Start a new round of work, and reset the statistics
+    void Start()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        stats = CCheckQueueStats();
+        nStealMicros = 0;
+        nSteals = 0;
+        nBatches = 0;
+        nBatchChecks = 0;
+        nMinBatch = 0;
+        nMaxBatch = 0;
+        nStartTime = NowMicros();
+    }
+
+    //! Statistics of the last round of work
+    CCheckQueueStats GetStats()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return stats;
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
+
+        // Spread large batches over the workers, the rest of the balancing is done by stealing
+        std::vector<size_t> vWorkers;
+        for (size_t i = 1; i < vQueues.size(); i++)
+            if (vQueues[i].fActive)
+                vWorkers.push_back(i);
+        size_t nChunk = vChecks.size();
+        if (!vWorkers.empty())
+            nChunk = std::max<size_t>(nBatchSize, (vChecks.size() + vWorkers.size() - 1) / vWorkers.size());
+        for (size_t nPos = 0; nPos < vChecks.size(); nPos += nChunk) {
+            WorkerQueue& queue = vQueues[vWorkers.empty() ? 0 : vWorkers[nNextQueue++ % vWorkers.size()]];
+            size_t nEnd = std::min(vChecks.size(), nPos + nChunk);
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            for (size_t i = nPos; i < nEnd; i++) {
+                queue.checks.push_back(T());
+                vChecks[i].swap(queue.checks.back());
+            }
+            queue.nSize = queue.checks.size();
+            nQueued += nEnd - nPos;
+        }
+
+        // Wake no more sleeping workers than there are checks for
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (size_t i = std::min<size_t>(nIdle, vChecks.size()); i > 0; i--)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
@@ -164,11 +391,11 @@ public:
     bool IsIdle()
     {
         boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nQueued == 0 && nTodo == 0 && fAllOk == true);
     }
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
@@ -186,6 +413,7 @@ public:
         if (pqueue != nullptr) {
             bool isIdle = pqueue->IsIdle();
             assert(isIdle);
+            pqueue->Start();
         }
     }
 
@@ -5,7 +5,9 @@
 
 #include "coins.h"
 
+#include "clientversion.h"
 #include "random.h"
+#include "streams.h"
 
 #include <assert.h>
 
@@ -58,12 +60,102 @@ bool CCoins::Spend(int nPos)
     return Spend(out, undo);
 }
 
+/** Serialized size of a record in the coins database, including its key */
+static int64_t GetRecordSize(const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return 0;
+    return 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+}
+
+/** The MuHash element of an unspent output */
+static CDataStream GetOutputElement(const uint256& txid, unsigned int n, const CTxOut& out, const CCoins& coins)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << txid << VARINT(n);
+    ss << VARINT(coins.nHeight * 4 + (coins.fCoinBase ? 2 : 0) + (coins.fCoinStake ? 1 : 0));
+    ss << out;
+    return ss;
+}
+
+void CCoinsTally::AddRecord(const CCoins& coins)
+{
+    if (!coins.IsPruned())
+        nTransactions++;
+    nSerializedSize += GetRecordSize(coins);
+}
+
+void CCoinsTally::RemoveRecord(const CCoins& coins)
+{
+    if (!coins.IsPruned())
+        nTransactions--;
+    nSerializedSize -= GetRecordSize(coins);
+}
+
+void CCoinsTally::AddOutput(const uint256& txid, unsigned int n, const CTxOut& out, const CCoins& coins)
+{
+    CDataStream ss = GetOutputElement(txid, n, out, coins);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs++;
+    nTotalAmount += out.nValue;
+}
+
+void CCoinsTally::RemoveOutput(const uint256& txid, unsigned int n, const CTxOut& out, const CCoins& coins)
+{
+    CDataStream ss = GetOutputElement(txid, n, out, coins);
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs--;
+    nTotalAmount -= out.nValue;
+}
+
+void CCoinsTally::AddCoins(const uint256& txid, const CCoins& coins)
+{
+    AddRecord(coins);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            AddOutput(txid, i, coins.vout[i], coins);
+    }
+}
+
+void CCoinsTally::RemoveCoins(const uint256& txid, const CCoins& coins)
+{
+    RemoveRecord(coins);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            RemoveOutput(txid, i, coins.vout[i], coins);
+    }
+}
+
+CCoinsTally& CCoinsTally::operator+=(const CCoinsTally& delta)
+{
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nSerializedSize += delta.nSerializedSize;
+    nTotalAmount += delta.nTotalAmount;
+    muhash *= delta.muhash;
+    return *this;
+}
+
 
 bool CCoinsView::GetCoins(const uint256& txid, CCoins& coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256& txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
-bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
-bool CCoinsView::GetStats(CCoinsStats& stats) const { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally) { return false; }
+bool CCoinsView::GetTally(CCoinsTally& tally) const { return false; }
+
+bool CCoinsView::GetStats(CCoinsStats& stats) const
+{
+    CCoinsTally tally;
+    if (!GetTally(tally))
+        return false;
+    stats.hashBlock = GetBestBlock();
+    stats.nTransactions = tally.nTransactions;
+    stats.nTransactionOutputs = tally.nTransactionOutputs;
+    stats.nSerializedSize = tally.nSerializedSize;
+    stats.nTotalAmount = tally.nTotalAmount;
+    tally.muhash.Finalize(stats.hashMuHash.begin());
+    return true;
+}
 
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView* viewIn) : base(viewIn) {}
@@ -71,8 +163,8 @@ bool CCoinsViewBacked::GetCoins(const uint256& txid, CCoins& coins) const { retu
 bool CCoinsViewBacked::HaveCoins(const uint256& txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView& viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
-bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStats(stats); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally) { return base->BatchWrite(mapCoins, hashBlock, tally); }
+bool CCoinsViewBacked::GetTally(CCoinsTally& tally) const { return base->GetTally(tally); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
@@ -140,6 +232,11 @@ const CCoins* CCoinsViewCache::AccessCoins(const uint256& txid) const
     }
 }
 
+bool CCoinsViewCache::HaveCoinsInCache(const uint256& txid) const
+{
+    return cacheCoins.count(txid) != 0;
+}
+
 bool CCoinsViewCache::HaveCoins(const uint256& txid) const
 {
     CCoinsMap::const_iterator it = FetchCoins(txid);
@@ -162,7 +259,15 @@ void CCoinsViewCache::SetBestBlock(const uint256& hashBlockIn)
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn)
+bool CCoinsViewCache::GetTally(CCoinsTally& tallyOut) const
+{
+    if (!base->GetTally(tallyOut))
+        return false;
+    tallyOut += tally;
+    return true;
+}
+
+bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn, const CCoinsTally& tallyIn)
 {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -196,13 +301,15 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
         mapCoins.erase(itOld);
     }
     hashBlock = hashBlockIn;
+    tally += tallyIn;
     return true;
 }
 
 bool CCoinsViewCache::Flush()
 {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, tally);
     cacheCoins.clear();
+    tally = CCoinsTally();
     return fOk;
 }
 
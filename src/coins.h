@@ -7,6 +7,7 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "crypto/muhash.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -318,13 +319,55 @@ struct CCoinsCacheEntry {
 
 typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
+/**
+ * Running totals over the unspent outputs of a coins view, including an
+ * order-independent MuHash of all outputs. Caches keep the change made
+ * through UpdateCoins and DisconnectBlock since their last flush, the coins
+ * database keeps the totals next to its best block.
+ */
+class CCoinsTally
+{
+public:
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    int64_t nSerializedSize;
+    CAmount nTotalAmount;
+    MuHash3072 muhash;
+
+    CCoinsTally() : nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    //! Account for a transaction's record appearing in (or vanishing from) the set; call before and after modifying it
+    void AddRecord(const CCoins& coins);
+    void RemoveRecord(const CCoins& coins);
+    //! Account for output n of a transaction's record, using the record's height and flags
+    void AddOutput(const uint256& txid, unsigned int n, const CTxOut& out, const CCoins& coins);
+    void RemoveOutput(const uint256& txid, unsigned int n, const CTxOut& out, const CCoins& coins);
+    //! Account for a whole record including all its available outputs
+    void AddCoins(const uint256& txid, const CCoins& coins);
+    void RemoveCoins(const uint256& txid, const CCoins& coins);
+
+    CCoinsTally& operator+=(const CCoinsTally& delta);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
 struct CCoinsStats {
     int nHeight;
     uint256 hashBlock;
     uint64_t nTransactions;
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
-    uint256 hashSerialized;
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
@@ -346,8 +389,11 @@ public:
     virtual uint256 GetBestBlock() const;
 
     //! Do a bulk modification (multiple CCoins changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    //! The passed mapCoins can be modified, tally holds the change in statistics it causes.
+    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally);
+
+    //! Retrieve the running totals over the unspent transaction output set
+    virtual bool GetTally(CCoinsTally& tally) const;
 
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats) const;
@@ -369,8 +415,8 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
-    bool GetStats(CCoinsStats& stats) const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally);
+    bool GetTally(CCoinsTally& tally) const;
 };
 
 class CCoinsViewCache;
@@ -421,6 +467,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Change in statistics made through this cache since the last flush. */
+    CCoinsTally tally;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -430,7 +479,11 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256& hashBlock);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally);
+    bool GetTally(CCoinsTally& tally) const;
+
+    //! Statistics delta of this cache, to be kept up to date by whoever modifies coins through it
+    CCoinsTally& GetTallyDelta() { return tally; }
 
     /**
      * Return a pointer to CCoins in the cache, or nullptr if not found. This is
@@ -439,6 +492,9 @@ public:
      */
     const CCoins* AccessCoins(const uint256& txid) const;
 
+    //! Check whether coins of the transaction are in this cache, without looking them up in the base view
+    bool HaveCoinsInCache(const uint256& txid) const;
+
     /**
      * Return a modifiable reference to a CCoins. If no entry with the given
      * txid exists, a new one is created. Simultaneous modifications are not
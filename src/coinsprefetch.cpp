@@ -0,0 +1,162 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* baseIn, size_t nMaxUsageIn, int nThreads) : CCoinsViewBacked(baseIn), nUsage(0), nMaxUsage(nMaxUsageIn), nGeneration(0), nWriting(0), fStop(false), nHits(0), nMisses(0)
+{
+    for (int i = 0; i < nThreads; i++)
+        workers.create_thread(boost::bind(&CCoinsViewPrefetch::Worker, this));
+}
+
+CCoinsViewPrefetch::~CCoinsViewPrefetch()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+        cond.notify_all();
+    }
+    workers.join_all();
+}
+
+size_t CCoinsViewPrefetch::Usage(const CCoins& coins)
+{
+    size_t n = sizeof(Entry) + sizeof(uint256) + 4 * sizeof(void*) + coins.vout.capacity() * sizeof(CTxOut);
+    for (const CTxOut& out : coins.vout)
+        n += out.scriptPubKey.allocated_memory();
+    return n;
+}
+
+void CCoinsViewPrefetch::Evict()
+{
+    while (nUsage > nMaxUsage && !dequeOrder.empty()) {
+        EntryMap::iterator it = mapEntries.find(dequeOrder.front());
+        dequeOrder.pop_front();
+        if (it != mapEntries.end()) {
+            nUsage -= it->second.nUsage;
+            mapEntries.erase(it);
+        }
+    }
+    // Drop the keys of entries that were taken once they make up most of the list
+    if (dequeOrder.size() > 2 * mapEntries.size() + 1024) {
+        std::deque<uint256> dequeKept;
+        for (const uint256& txid : dequeOrder) {
+            if (mapEntries.count(txid))
+                dequeKept.push_back(txid);
+        }
+        dequeOrder.swap(dequeKept);
+    }
+}
+
+void CCoinsViewPrefetch::Worker()
+{
+    RenameThread("bitgreen-prefetch");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (!fStop && dequeTodo.empty())
+            cond.wait(lock);
+        if (fStop)
+            return;
+        uint256 txid = dequeTodo.front();
+        dequeTodo.pop_front();
+        if (mapEntries.count(txid))
+            continue;
+        uint64_t nStartGeneration = nGeneration;
+        lock.unlock();
+
+        // Errors are left for the connecting thread to run into when it reads the same coins
+        CCoins coins;
+        bool fFound = false;
+        try {
+            fFound = base->GetCoins(txid, coins) && !coins.IsPruned();
+        } catch (const std::exception& e) {
+            LogPrint("coindb", "%s: reading %s failed: %s\n", __func__, txid.ToString(), e.what());
+        }
+
+        lock.lock();
+        if (!fFound || nWriting || nGeneration != nStartGeneration || mapEntries.count(txid))
+            continue;
+        Entry& entry = mapEntries[txid];
+        entry.coins.swap(coins);
+        entry.nUsage = Usage(entry.coins);
+        nUsage += entry.nUsage;
+        dequeOrder.push_back(txid);
+        Evict();
+    }
+}
+
+bool CCoinsViewPrefetch::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        EntryMap::iterator it = mapEntries.find(txid);
+        if (it != mapEntries.end()) {
+            // The cache above keeps its own copy from now on
+            coins.swap(it->second.coins);
+            nUsage -= it->second.nUsage;
+            mapEntries.erase(it);
+            nHits++;
+            return true;
+        }
+        nMisses++;
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewPrefetch::HaveCoins(const uint256& txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (mapEntries.count(txid))
+            return true;
+    }
+    return base->HaveCoins(txid);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end() && !mapEntries.empty(); it++) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            EntryMap::iterator itEntry = mapEntries.find(it->first);
+            if (itEntry != mapEntries.end()) {
+                nUsage -= itEntry->second.nUsage;
+                mapEntries.erase(itEntry);
+            }
+        }
+        nWriting++;
+    }
+    bool fOk = base->BatchWrite(mapCoins, hashBlock, tally);
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWriting--;
+        nGeneration++;
+    }
+    return fOk;
+}
+
+void CCoinsViewPrefetch::Prefetch(const std::vector<uint256>& vTxids)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (const uint256& txid : vTxids) {
+        if (dequeTodo.size() >= MAX_COINS_PREFETCH_QUEUE)
+            break;
+        if (!mapEntries.count(txid))
+            dequeTodo.push_back(txid);
+    }
+    cond.notify_all();
+}
+
+void CCoinsViewPrefetch::GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nHitsOut = nHits;
+    nMissesOut = nMisses;
+}
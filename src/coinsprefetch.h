@@ -0,0 +1,85 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include "coins.h"
+
+#include <deque>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+//! Default for -utxoprefetch, reading the inputs of received blocks ahead
+static const bool DEFAULT_UTXO_PREFETCH = true;
+//! Number of threads reading coins ahead of block connection
+static const int COINS_PREFETCH_THREADS = 4;
+//! Maximum number of transactions waiting to be read ahead
+static const size_t MAX_COINS_PREFETCH_QUEUE = 100000;
+
+/**
+ * CCoinsView layer under the chain tip cache that reads the coins of blocks
+ * that are about to be connected on worker threads. Random reads from the
+ * coins database are latency bound, so reading the inputs of a block in
+ * parallel before it reaches ConnectBlock avoids waiting for them one at a
+ * time there.
+ *
+ * The coins read ahead are kept until the cache above asks for them, which
+ * moves them out, or until they are evicted oldest first to stay within the
+ * memory budget. Only coins that exist in the base view are kept, and a
+ * write through this view drops the ones it touches and discards reads that
+ * overlapped with it, so what is kept always matches the base view.
+ */
+class CCoinsViewPrefetch : public CCoinsViewBacked
+{
+private:
+    struct Entry {
+        CCoins coins;
+        size_t nUsage;
+    };
+    typedef boost::unordered_map<uint256, Entry, CCoinsKeyHasher> EntryMap;
+
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    mutable EntryMap mapEntries;
+    //! Read order, for eviction; may still list entries that were taken already
+    std::deque<uint256> dequeOrder;
+    mutable size_t nUsage;
+    size_t nMaxUsage;
+
+    std::deque<uint256> dequeTodo;
+    //! Bumped after every write, reads started before it are not kept
+    uint64_t nGeneration;
+    //! Writes in progress, no reads are kept meanwhile
+    int nWriting;
+    bool fStop;
+    boost::thread_group workers;
+
+    mutable uint64_t nHits;
+    mutable uint64_t nMisses;
+
+    //! Approximate memory held by a coins entry
+    static size_t Usage(const CCoins& coins);
+
+    void Evict();
+    void Worker();
+
+public:
+    CCoinsViewPrefetch(CCoinsView* baseIn, size_t nMaxUsageIn, int nThreads = COINS_PREFETCH_THREADS);
+    ~CCoinsViewPrefetch();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally);
+
+    //! Start reading the coins of these transactions
+    void Prefetch(const std::vector<uint256>& vTxids);
+
+    //! Number of lookups answered with and without a coins entry read ahead, since startup
+    void GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut) const;
+};
+
+#endif // BITCOIN_COINSPREFETCH_H
@@ -0,0 +1,154 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinswritebehind.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+
+CCoinsViewWriteBehind::CCoinsViewWriteBehind(CCoinsView* baseIn) : CCoinsViewBacked(baseIn), fPending(false), fFailed(false), fStop(false)
+{
+    thread = boost::thread(boost::bind(&CCoinsViewWriteBehind::Writer, this));
+}
+
+CCoinsViewWriteBehind::~CCoinsViewWriteBehind()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+        cond.notify_all();
+    }
+    thread.join();
+}
+
+void CCoinsViewWriteBehind::Writer()
+{
+    RenameThread("bitgreen-coinswr");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (!fStop && (!fPending || fFailed))
+            cond.wait(lock);
+        if (!fPending || fFailed)
+            return;
+
+        // The snapshot does not change while it is pending, lookups only read it
+        lock.unlock();
+        int64_t nStart = GetTimeMicros();
+        size_t nCount = mapPending.size();
+        bool fOk = false;
+        try {
+            fOk = base->BatchWrite(mapPending, hashBlockPending, tallyPending);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint("coindb", "Wrote %u cached transactions in the background in %.2fms\n", (unsigned int)nCount, 0.001 * (GetTimeMicros() - nStart));
+
+        CCoinsMap mapDone;
+        lock.lock();
+        if (fOk) {
+            mapDone.swap(mapPending);
+            fPending = false;
+        } else {
+            LogPrintf("ERROR: %s: failed to write to coin database\n", __func__);
+            fFailed = true;
+        }
+        cond.notify_all();
+        // Free the snapshot without holding up lookups
+        lock.unlock();
+        mapDone.clear();
+        lock.lock();
+    }
+}
+
+bool CCoinsViewWriteBehind::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fPending) {
+            CCoinsMap::const_iterator it = mapPending.find(txid);
+            if (it != mapPending.end()) {
+                // Pruned entries are deleted from the database
+                if (it->second.coins.IsPruned())
+                    return false;
+                coins = it->second.coins;
+                return true;
+            }
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewWriteBehind::HaveCoins(const uint256& txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fPending) {
+            CCoinsMap::const_iterator it = mapPending.find(txid);
+            if (it != mapPending.end())
+                return !it->second.coins.IsPruned();
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewWriteBehind::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fPending && !hashBlockPending.IsNull())
+            return hashBlockPending;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewWriteBehind::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fPending && !fFailed) {
+        int64_t nStart = GetTimeMicros();
+        while (fPending && !fFailed)
+            cond.wait(lock);
+        LogPrint("coindb", "Waited %.2fms for the previous coins write\n", 0.001 * (GetTimeMicros() - nStart));
+    }
+    if (fFailed)
+        return false;
+
+    // Nothing is being written, so the base statistics are stable
+    if (!base->GetTally(tallyAfter))
+        return false;
+    tallyAfter += tally;
+    tallyPending = tally;
+    hashBlockPending = hashBlock;
+    mapPending.clear();
+    mapPending.swap(mapCoins);
+    fPending = true;
+    cond.notify_all();
+    return true;
+}
+
+bool CCoinsViewWriteBehind::GetTally(CCoinsTally& tally) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fPending) {
+        tally = tallyAfter;
+        return true;
+    }
+    return base->GetTally(tally);
+}
+
+bool CCoinsViewWriteBehind::Sync()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (fPending && !fFailed)
+        cond.wait(lock);
+    return !fFailed;
+}
+
+bool CCoinsViewWriteBehind::HasFailed() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return fFailed;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSWRITEBEHIND_H
+#define BITCOIN_COINSWRITEBEHIND_H
+
+#include "coins.h"
+
+#include <boost/thread.hpp>
+
+/**
+ * CCoinsView layer over the coins database that writes flushed changes on a
+ * background thread. BatchWrite takes over the flushed map as an immutable
+ * snapshot and returns at once, so the cache above can be emptied and used
+ * again while the snapshot is serialized and written. Until the write has
+ * been committed, lookups are answered from the snapshot first.
+ *
+ * At most one snapshot is written at a time: a second flush waits for the
+ * first one to be committed. Each snapshot is committed in a single batch
+ * together with its best block, so the database is always at the state of
+ * one of the flushes, as it was with synchronous writes; a crash before a
+ * write is committed leaves the previous best block in place and the blocks
+ * after it are connected again at the next start.
+ *
+ * The base view must not modify the map passed to BatchWrite, as it is read
+ * from at the same time.
+ */
+class CCoinsViewWriteBehind : public CCoinsViewBacked
+{
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+
+    //! Changes handed over and not committed yet, valid while fPending
+    CCoinsMap mapPending;
+    uint256 hashBlockPending;
+    CCoinsTally tallyPending;
+    //! Statistics of the base view once the pending changes are committed
+    CCoinsTally tallyAfter;
+    bool fPending;
+    bool fFailed;
+    bool fStop;
+    boost::thread thread;
+
+    void Writer();
+
+public:
+    CCoinsViewWriteBehind(CCoinsView* baseIn);
+    //! Waits for a pending write to be committed
+    ~CCoinsViewWriteBehind();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally);
+    bool GetTally(CCoinsTally& tally) const;
+
+    //! Wait until all changes handed over are committed; false if writing them failed
+    bool Sync();
+
+    //! Whether a background write has failed; the changes it held stay visible, but are not on disk
+    bool HasFailed() const;
+};
+
+#endif // BITCOIN_COINSWRITEBEHIND_H
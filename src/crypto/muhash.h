@@ -0,0 +1,96 @@
+// Copyright (c) 2017 The Bitcoin developers
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** An integer modulo the prime 2^3072 - 1103717, stored as little-endian 32-bit limbs. */
+class Num3072
+{
+public:
+    static const int LIMBS = 96;
+    static const size_t BYTE_SIZE = 384;
+
+    uint32_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+    void FromBytes(const unsigned char (&data)[BYTE_SIZE]);
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/**
+ * A rolling hash of a set of byte strings (MuHash, see "Incremental
+ * Multiset Hash Functions and Their Application to Memory Integrity
+ * Checking" by Clarke et al.).
+ *
+ * Every element is mapped to a number modulo a 3072-bit prime and the set
+ * hash is the product of these numbers. Because multiplication commutes,
+ * the result does not depend on the order elements were added in, and
+ * removing an element is a division. Divisions are accumulated in a
+ * separate denominator so that only Finalize() needs a modular inverse.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! Combine with the set of another hash (union of the added and removed elements)
+    MuHash3072& operator*=(const MuHash3072& mul);
+    //! Combine with the inverse of the set of another hash
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 2 * Num3072::BYTE_SIZE;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        numerator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+        denominator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        s.read((char*)data, sizeof(data));
+        numerator.FromBytes(data);
+        s.read((char*)data, sizeof(data));
+        denominator.FromBytes(data);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
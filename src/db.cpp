@@ -285,7 +285,8 @@ CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(nullptr), ac
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    // Transactions are flushed when they end
+    if (GetTxn())
         return;
 
     // Flush database activity from memory pool to disk log
@@ -419,6 +420,60 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
     return false;
 }
 
+bool CDBEnv::BatchBegin(const std::string& strFile)
+{
+    LOCK(cs_db);
+    if (!fDbEnvInit)
+        return false;
+    std::map<std::string, CBatchTxn>::iterator it = mapBatchTxn.find(strFile);
+    if (it != mapBatchTxn.end()) {
+        if (it->second.threadId != boost::this_thread::get_id())
+            return false;
+        it->second.nDepth++;
+        return true;
+    }
+
+    CBatchTxn batch;
+    batch.threadId = boost::this_thread::get_id();
+    batch.ptxn = TxnBegin();
+    batch.nDepth = 1;
+    if (!batch.ptxn)
+        return false;
+    mapBatchTxn[strFile] = batch;
+    // Keep the file from being closed by a flush while the batch is open
+    ++mapFileUseCount[strFile];
+    return true;
+}
+
+bool CDBEnv::BatchEnd(const std::string& strFile)
+{
+    LOCK(cs_db);
+    std::map<std::string, CBatchTxn>::iterator it = mapBatchTxn.find(strFile);
+    assert(it != mapBatchTxn.end() && it->second.threadId == boost::this_thread::get_id());
+    if (--it->second.nDepth > 0)
+        return true;
+
+    int ret = it->second.ptxn->commit(0);
+    mapBatchTxn.erase(it);
+    --mapFileUseCount[strFile];
+    if (ret != 0)
+        return error("CDBEnv::BatchEnd : Error %d committing the batch on %s: %s", ret, strFile, DbEnv::strerror(ret));
+
+    // Flush the log of the whole batch, as CDB::Flush() does for every handle
+    dbenv->txn_checkpoint(0, 0, 0);
+    return true;
+}
+
+DbTxn* CDBEnv::GetBatchTxn(const std::string& strFile)
+{
+    LOCK(cs_db);
+    if (mapBatchTxn.empty())
+        return nullptr;
+    std::map<std::string, CBatchTxn>::const_iterator it = mapBatchTxn.find(strFile);
+    if (it == mapBatchTxn.end() || it->second.threadId != boost::this_thread::get_id())
+        return nullptr;
+    return it->second.ptxn;
+}
 
 void CDBEnv::Flush(bool fShutdown)
 {
@@ -17,6 +17,7 @@
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <db_cxx.h>
 
@@ -39,6 +40,14 @@ private:
     // shutdown problems/crashes caused by a static initialized internal pointer.
     std::string strPath;
 
+    /** The open write batch of a database file, see CDBBatch */
+    struct CBatchTxn {
+        boost::thread::id threadId;
+        DbTxn* ptxn;
+        int nDepth; //!< number of nested CDBBatch scopes
+    };
+    std::map<std::string, CBatchTxn> mapBatchTxn;
+
     void EnvShutdown();
 
 public:
@@ -90,10 +99,50 @@ public:
             return nullptr;
         return ptxn;
     }
+
+    //! Open or join this thread's write batch on strFile; false if another thread has one open
+    bool BatchBegin(const std::string& strFile);
+    //! Leave the batch, committing it when the outermost scope ends; false if the commit failed
+    bool BatchEnd(const std::string& strFile);
+    //! The transaction of the write batch this thread has open on strFile, if any
+    DbTxn* GetBatchTxn(const std::string& strFile);
 };
 
 extern CDBEnv bitdb;
 
+/**
+ * Scoped write batch on a database file. Until the batch is committed or goes
+ * out of scope, whatever this thread writes to the file, through any CDB
+ * handle, goes into one BerkeleyDB transaction, so the log is written and the
+ * file checkpointed once instead of for every record. A batch opened inside
+ * another one on the same file is part of the outer one.
+ *
+ * Other threads writing to the file wait for the batch to end, so don't keep
+ * one open across waiting for a lock they may hold (e.g. cs_wallet).
+ */
+class CDBBatch
+{
+private:
+    std::string strFile;
+    bool fActive;
+
+    CDBBatch(const CDBBatch&);
+    void operator=(const CDBBatch&);
+
+public:
+    explicit CDBBatch(const std::string& strFileIn) : strFile(strFileIn), fActive(!strFile.empty() && bitdb.BatchBegin(strFile)) {}
+    ~CDBBatch() { Commit(); }
+
+    //! End the batch before it goes out of scope
+    bool Commit()
+    {
+        if (!fActive)
+            return true;
+        fActive = false;
+        return bitdb.BatchEnd(strFile);
+    }
+};
+
 
 /** RAII class that provides access to a Berkeley database */
 class CDB
@@ -115,6 +164,9 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    //! The explicit transaction of this handle, or else the write batch of this thread
+    DbTxn* GetTxn() { return activeTxn ? activeTxn : bitdb.GetBatchTxn(strFile); }
+
 protected:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
@@ -131,7 +183,7 @@ protected:
         // Read
         Dbt datValue;
         datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pdb->get(activeTxn, &datKey, &datValue, 0);
+        int ret = pdb->get(GetTxn(), &datKey, &datValue, 0);
         memset(datKey.get_data(), 0, datKey.get_size());
         if (datValue.get_data() == nullptr)
             return false;
@@ -171,7 +223,7 @@ protected:
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
-        int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+        int ret = pdb->put(GetTxn(), &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
 
         // Clear memory in case it was a private key
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -194,7 +246,7 @@ protected:
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
-        int ret = pdb->del(activeTxn, &datKey, 0);
+        int ret = pdb->del(GetTxn(), &datKey, 0);
 
         // Clear memory
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -214,7 +266,7 @@ protected:
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
-        int ret = pdb->exists(activeTxn, &datKey, 0);
+        int ret = pdb->exists(GetTxn(), &datKey, 0);
 
         // Clear memory
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -226,7 +278,7 @@ protected:
         if (!pdb)
             return nullptr;
         Dbc* pcursor = nullptr;
-        int ret = pdb->cursor(nullptr, &pcursor, 0);
+        int ret = pdb->cursor(GetTxn(), &pcursor, 0);
         if (ret != 0)
             return nullptr;
         return pcursor;
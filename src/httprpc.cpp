@@ -19,6 +19,8 @@
 
 #include <boost/algorithm/string.hpp> // boost::trim
 
+static const size_t MAX_RPC_STREAM_PENDING = 1024 * 1024; //max bytes queued for a slow client before writing on
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wellet.
  */
@@ -90,6 +92,60 @@ static bool RPCAuthorized(const std::string& strAuth)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
+/** JSONStreamWriter sink: start a chunked reply on the first chunk, then pass
+ * chunks on, waiting while the client is behind. Streaming methods write
+ * outside of their locks, so the wait holds nothing else up.
+ */
+static void JSONStreamToHTTP(HTTPRequest* req, const std::string& strChunk)
+{
+    if (!req->IsChunked()) {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReplyStart(HTTP_OK);
+    }
+    if (req->IsClosed())
+        throw std::runtime_error("client closed the connection");
+    req->WriteReplyChunk(strChunk);
+    if (!req->WaitForChunkBuffer(MAX_RPC_STREAM_PENDING))
+        throw std::runtime_error("client stopped reading the reply");
+}
+
+/** Execute a single request and send its reply. A reply that does not fit in
+ * one JSON_STREAM_CHUNK_SIZE chunk is sent with chunked transfer encoding
+ * while it is being produced.
+ * Errors raised before any output was sent are rethrown for the caller to
+ * report; later ones abort the connection.
+ */
+static void JSONRPCExecStream(HTTPRequest* req, const JSONRequest& jreq)
+{
+    JSONStreamWriter writer(std::bind(&JSONStreamToHTTP, req, std::placeholders::_1));
+    try {
+        writer.BeginObject();
+        writer.Key("result");
+        tableRPC.executeStream(jreq.strMethod, jreq.params, writer);
+        writer.Key("error");
+        writer.Value(NullUniValue);
+        writer.Key("id");
+        writer.Value(jreq.id);
+        writer.EndObject();
+        writer.Raw("\n");
+
+        if (req->IsChunked()) {
+            writer.Flush();
+            req->WriteReplyEnd();
+            return;
+        }
+    } catch (...) {
+        if (!req->IsChunked())
+            throw;
+        LogPrintf("%s: %s failed after part of the reply was sent, closing connection\n", __func__, SanitizeString(jreq.strMethod));
+        req->WriteReplyAbort();
+        return;
+    }
+
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, writer.ReleaseBuffer());
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -123,24 +179,20 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (!valRequest.read(req->ReadBody()))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-        std::string strReply;
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            JSONRPCExecStream(req, jreq);
 
         // array of requests
-        } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
-        else
+        } else if (valRequest.isArray()) {
+            std::string strReply = JSONRPCExecBatch(valRequest.get_array());
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strReply);
+        } else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
-
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
         return false;
@@ -21,7 +21,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <future>
+#include <mutex>
 
 #include <event2/event.h>
 #include <event2/http.h>
@@ -538,6 +542,43 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+/** State of a chunked reply, shared between the worker producing it and the
+ * main http thread sending it. The connection close callback and all chunk
+ * sends run in the main http thread; fClosed is atomic so that the worker can
+ * stop producing output for a client that went away.
+ */
+struct HTTPChunkedReplyState
+{
+    std::atomic<bool> fClosed;
+    /** Protects nPending */
+    std::mutex cs;
+    std::condition_variable cond;
+    /** Chunk bytes queued since the connection's output buffer last drained */
+    size_t nPending;
+
+    HTTPChunkedReplyState() : fClosed(false), nPending(0) {}
+};
+
+/** Callback for connections closed during a chunked reply. evhttp frees the
+ * request right after this, so no further chunks may be sent.
+ */
+static void http_chunked_close_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkedReplyState* state = static_cast<HTTPChunkedReplyState*>(arg);
+    std::lock_guard<std::mutex> lock(state->cs);
+    state->fClosed = true;
+    state->cond.notify_all();
+}
+
+/** Callback for the connection's output buffer being written out completely */
+static void http_chunk_sent_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkedReplyState* state = static_cast<HTTPChunkedReplyState*>(arg);
+    std::lock_guard<std::mutex> lock(state->cs);
+    state->nPending = 0;
+    state->cond.notify_all();
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
                                                        replySent(false)
 {
@@ -547,7 +588,10 @@ HTTPRequest::~HTTPRequest()
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
-        WriteReply(HTTP_INTERNAL, "Unhandled request");
+        if (chunkedState)
+            WriteReplyEnd();
+        else
+            WriteReply(HTTP_INTERNAL, "Unhandled request");
     }
     // evhttpd cleans up the request, as long as a reply was sent.
 }
@@ -609,6 +653,105 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && req && !chunkedState);
+    chunkedState = std::make_shared<HTTPChunkedReplyState>();
+    struct evhttp_request* reqIn = req;
+    std::shared_ptr<HTTPChunkedReplyState> state = chunkedState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reqIn, state, nStatus]() {
+        evhttp_connection* con = evhttp_request_get_connection(reqIn);
+        if (con)
+            evhttp_connection_set_closecb(con, http_chunked_close_cb, state.get());
+        evhttp_send_reply_start(reqIn, nStatus, nullptr);
+    });
+    ev->trigger(0);
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && req && chunkedState);
+    if (chunkedState->fClosed)
+        return;
+    // Each chunk gets its own buffer, so the worker never touches a buffer
+    // that the main http thread is draining.
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    {
+        std::lock_guard<std::mutex> lock(chunkedState->cs);
+        chunkedState->nPending += strChunk.size();
+    }
+    struct evhttp_request* reqIn = req;
+    std::shared_ptr<HTTPChunkedReplyState> state = chunkedState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reqIn, state, evb]() {
+        if (!state->fClosed)
+            evhttp_send_reply_chunk_with_cb(reqIn, evb, http_chunk_sent_cb, state.get());
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+}
+
+bool HTTPRequest::WaitForChunkBuffer(size_t nMaxPending)
+{
+    assert(!replySent && req && chunkedState);
+    std::unique_lock<std::mutex> lock(chunkedState->cs);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(DEFAULT_HTTP_SERVER_TIMEOUT);
+    while (!chunkedState->fClosed && chunkedState->nPending >= nMaxPending) {
+        if (chunkedState->cond.wait_until(lock, deadline) == std::cv_status::timeout) {
+            LogPrint("http", "%s: client did not read reply data for %d seconds\n", __func__, DEFAULT_HTTP_SERVER_TIMEOUT);
+            return false;
+        }
+    }
+    return !chunkedState->fClosed;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(!replySent && req && chunkedState);
+    struct evhttp_request* reqIn = req;
+    std::shared_ptr<HTTPChunkedReplyState> state = chunkedState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reqIn, state]() {
+        if (state->fClosed)
+            return; // evhttp already freed the request
+        evhttp_connection* con = evhttp_request_get_connection(reqIn);
+        if (con)
+            evhttp_connection_set_closecb(con, nullptr, nullptr);
+        evhttp_send_reply_end(reqIn);
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+void HTTPRequest::WriteReplyAbort()
+{
+    assert(!replySent && req && chunkedState);
+    struct evhttp_request* reqIn = req;
+    std::shared_ptr<HTTPChunkedReplyState> state = chunkedState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reqIn, state]() {
+        if (state->fClosed)
+            return;
+        // Freeing the connection runs the close callback and frees the request
+        evhttp_connection* con = evhttp_request_get_connection(reqIn);
+        if (con)
+            evhttp_connection_free(con);
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+bool HTTPRequest::IsChunked() const
+{
+    return chunkedState != nullptr;
+}
+
+bool HTTPRequest::IsClosed() const
+{
+    return chunkedState && chunkedState->fClosed;
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
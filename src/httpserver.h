@@ -8,6 +8,7 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -17,6 +18,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReplyState;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -55,6 +57,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    std::shared_ptr<HTTPChunkedReplyState> chunkedState;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -110,6 +113,50 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply with status nStatus.
+     * Follow with any number of WriteReplyChunk calls and finish with WriteReplyEnd.
+     *
+     * @note call WriteHeader before this, and do not call WriteReply afterwards.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Send a chunk of a reply started with WriteReplyStart.
+     * Chunks are handed to the main http thread without waiting for them to be sent.
+     */
+    void WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Wait until less than nMaxPending bytes of chunks are waiting to be
+     * written to the client. Use this to bound the memory of long replies that
+     * are not produced while holding a lock.
+     * Returns false if the client went away or did not read anything for
+     * DEFAULT_HTTP_SERVER_TIMEOUT seconds.
+     */
+    bool WaitForChunkBuffer(size_t nMaxPending);
+
+    /**
+     * Finish a chunked reply.
+     *
+     * @note As with WriteReply, do not call any other HTTPRequest methods after calling this.
+     */
+    void WriteReplyEnd();
+
+    /**
+     * Abort a chunked reply by closing the connection, so the client sees an
+     * incomplete transfer instead of a truncated but well-formed reply.
+     *
+     * @note As with WriteReply, do not call any other HTTPRequest methods after calling this.
+     */
+    void WriteReplyAbort();
+
+    /** Whether a chunked reply was started */
+    bool IsChunked() const;
+
+    /** Whether the client closed the connection while a chunked reply was in progress */
+    bool IsClosed() const;
 };
 
 /** Event handler closure.
@@ -63,6 +63,14 @@ bool CBasicKeyStore::GetCScript(const CScriptID& hash, CScript& redeemScriptOut)
     return false;
 }
 
+void CBasicKeyStore::GetCScripts(std::set<CScriptID>& setScriptID) const
+{
+    setScriptID.clear();
+    LOCK(cs_KeyStore);
+    for (const ScriptMap::value_type& item : mapScripts)
+        setScriptID.insert(item.first);
+}
+
 bool CBasicKeyStore::AddWatchOnly(const CScript& dest)
 {
     LOCK(cs_KeyStore);
@@ -89,6 +97,12 @@ bool CBasicKeyStore::HaveWatchOnly() const
     return (!setWatchOnly.empty());
 }
 
+void CBasicKeyStore::GetWatchOnly(WatchOnlySet& setWatchOnlyOut) const
+{
+    LOCK(cs_KeyStore);
+    setWatchOnlyOut = setWatchOnly;
+}
+
 bool CBasicKeyStore::AddMultiSig(const CScript& dest)
 {
     LOCK(cs_KeyStore);
@@ -115,6 +129,12 @@ bool CBasicKeyStore::HaveMultiSig() const
     return (!setMultiSig.empty());
 }
 
+void CBasicKeyStore::GetMultiSig(MultiSigScriptSet& setMultiSigOut) const
+{
+    LOCK(cs_KeyStore);
+    setMultiSigOut = setMultiSig;
+}
+
 bool CBasicKeyStore::HaveKey(const CKeyID& address) const
 {
     bool result;
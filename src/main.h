@@ -13,6 +13,7 @@
 #include "config/bitgreen-config.h"
 #endif
 
+#include "addressindex.h"
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -24,6 +25,7 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "spentindex.h"
 #include "sync.h"
 #include "tinyformat.h"
 #include "txmempool.h"
@@ -33,6 +35,7 @@
 #include "masternode-sync.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
 #include <map>
 #include <set>
@@ -45,6 +48,8 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewPrefetch;
+class CCoinsViewWriteBehind;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
@@ -84,6 +89,8 @@ static const unsigned int LOCKTIME_THRESHOLD = 500000000; // Tue Nov  5 00:53:20
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of blocks VerifyDB reads and checks ahead of the block it is processing */
+static const unsigned int MAX_VERIFYDB_READ_AHEAD = 64;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -100,6 +107,14 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
+/** Block files containing a block within this many blocks of the tip are never pruned: a day of blocks
+ *  covers any reorganisation we accept and the inputs a coinstake can still be checked against. */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 1440;
+
+/** Defaults for -addressindex, -spentindex and -timestampindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_TIMESTAMPINDEX = false;
 
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
@@ -121,14 +136,10 @@ static const unsigned char REJECT_DUST = 0x41;
 static const unsigned char REJECT_INSUFFICIENTFEE = 0x42;
 static const unsigned char REJECT_CHECKPOINT = 0x43;
 
-struct BlockHasher {
-    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
-};
-
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
-typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef CBlockIndexMap BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
@@ -140,6 +151,9 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
@@ -164,6 +178,21 @@ extern CBlockIndex* pindexBestHeader;
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
+/** Pruning-related variables and constants */
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of MiB of block files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+/** Minimum target for -prune: the undeletable recent blocks plus a block and undo file being written to */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
+
+/** Block whose ancestors are assumed to have valid scripts, see -assumevalid (null to check all) */
+extern uint256 hashAssumeValid;
+/** Blocks closer than this to the best header have their scripts checked regardless of -assumevalid */
+static const int64_t ASSUMEVALID_MIN_BURIAL_TIME = 60 * 60 * 24 * 7 * 2;
+
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
@@ -217,6 +246,16 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false);
+/** Same, sharing the copy held by the memory pool or the block instead of copying it out */
+bool GetTransaction(const uint256& hash, CTransactionRef& tx, uint256& hashBlock, bool fAllowSlow = false);
+/** Look up the confirmed entries of an address in the address index, optionally limited to a height range */
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+/** Look up the confirmed unspent outputs of an address */
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+/** Look up the input spending an output, in the mempool or the spent index */
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+/** Look up the hashes of active chain blocks with low <= time <= high */
+bool GetTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256>& vHashes);
 /** Find the best known block, and make it the tip of the block chain */
 
 // ***TODO***
@@ -237,10 +276,26 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+/** Calculate the amount of disk space the block and undo files currently use */
+uint64_t CalculateCurrentUsage();
+
+/** Keeps pruning away from block files that are read without cs_main, for as long as it lives */
+class CBlockFilesPin
+{
+public:
+    //! Requires cs_main, so that nothing is pruned between checking the blocks are there and pinning their files
+    explicit CBlockFilesPin(const std::set<int>& setFilesIn);
+    ~CBlockFilesPin();
+
+private:
+    std::set<int> setFiles;
+};
 
 
 /** (try to) add transaction to memory pool **/
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false);
 
@@ -327,7 +382,7 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  * This does not modify the UTXO set. If pvChecks is not nullptr, script checks are pushed onto it
  * instead of being performed inline.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = nullptr);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = nullptr, const PrecomputedTransactionData* ptxdata = nullptr);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
@@ -384,11 +439,12 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    const PrecomputedTransactionData* txdata;
 
 public:
-    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-                                                                                                                                ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr) {}
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, const PrecomputedTransactionData* txdataIn = nullptr) : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+                                                                                                                                ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) {}
 
     bool operator()();
 
@@ -400,6 +456,7 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(txdata, check.txdata);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -417,8 +474,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = nullptr);
+ *  of problems. Note that in any case, coins may be modified.
+ *  With fJustCheck the address, spent and timestamp indexes are left untouched. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = nullptr, bool fJustCheck = false);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -428,6 +486,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
+/** The checks of CheckBlock that only look at the block itself, they can run without cs_main.
+ *  Passing them with fCheckPOW and fCheckMerkleRoot is remembered in the block. */
+bool CheckBlockContents(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/** The checks of CheckBlock against the chain, stake and masternode state (requires cs_main) */
+bool CheckBlockAgainstChain(const CBlock& block, CValidationState& state);
+/** CheckBlockContents and CheckBlockAgainstChain */
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
 
@@ -583,6 +647,35 @@ public:
     bool VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/** Progress of the running or last VerifyDB, reported by getblockchaininfo */
+struct CVerifyDBProgress {
+    enum Phase {
+        VERIFY_NONE,         //! not run yet
+        VERIFY_CHECKING,     //! checks of levels 0-3, from the tip back
+        VERIFY_RECONNECTING, //! level 4, reconnecting the disconnected blocks
+        VERIFY_DONE,
+        VERIFY_FAILED,
+        VERIFY_INTERRUPTED,  //! stopped by a shutdown, the next run at the same tip resumes
+    };
+
+    std::atomic<int> nPhase;
+    std::atomic<int> nCheckLevel;
+    std::atomic<int> nHeight;      //! block being verified
+    std::atomic<int> nBlocks;      //! blocks done in this phase
+    std::atomic<int> nBlocksTotal; //! blocks to do in this phase
+    std::atomic<int> nResumeHeight; //! blocks from this height up were checked by an earlier interrupted run, or -1
+
+    //! Chain state when the run started, VerifyDB leaves the tip where it found it
+    std::atomic<CBlockIndex*> pindexTip;
+    std::atomic<int> nHeaders;
+    std::atomic<int> nPruneHeight;
+
+    CVerifyDBProgress() : nPhase(VERIFY_NONE), nCheckLevel(0), nHeight(0), nBlocks(0), nBlocksTotal(0), nResumeHeight(-1),
+                          pindexTip(nullptr), nHeaders(-1), nPruneHeight(0) {}
+};
+
+extern CVerifyDBProgress verifyDBProgress;
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -598,6 +691,12 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Global variable that points to the coins read-ahead layer under pcoinsTip, if enabled */
+extern CCoinsViewPrefetch* pcoinsPrefetch;
+
+/** Global variable that points to the layer writing flushed coins to the database in the background */
+extern CCoinsViewWriteBehind* pcoinsWriteBehind;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
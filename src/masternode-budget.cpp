@@ -1035,7 +1035,7 @@ void CBudgetManager::NewBlock()
     LogPrint("mnbudget","CBudgetManager::NewBlock - PASSED\n");
 }
 
-void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CPlainDataStream& vRecv)
 {
     // lite mode is not supported
     if (fLiteMode) return;
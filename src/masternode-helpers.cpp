@@ -51,6 +51,16 @@ bool CMasternodeSigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey)
     CScript payee2;
     payee2 = GetScriptForDestination(pubkey.GetID());
 
+    // the collateral is normally unspent: check it in the UTXO set, which outlives pruned blocks
+    {
+        LOCK(cs_main);
+        const CCoins* coins = pcoinsTip->AccessCoins(vin.prevout.hash);
+        if (coins && coins->IsAvailable(vin.prevout.n)) {
+            const CTxOut& out = coins->vout[vin.prevout.n];
+            if (out.nValue == MASTERNODE_COLLATERAL * COIN && out.scriptPubKey == payee2) return true;
+        }
+    }
+
     CTransaction txVin;
     uint256 hash;
     if (GetTransaction(vin.prevout.hash, txVin, hash, true)) {
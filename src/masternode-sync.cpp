@@ -207,7 +207,7 @@ std::string CMasternodeSync::GetSyncStatus()
     return "";
 }
 
-void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CPlainDataStream& vRecv)
 {
     if (strCommand == "ssc") { //Sync status count
         int nItemID;
@@ -434,7 +434,7 @@ void CCommunityVoteManager::NewBlock()
     LogPrint("mncommunityvote", "CCommunityVoteManager::NewBlock - PASSED\n");
 }
 
-void CCommunityVoteManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+void CCommunityVoteManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CPlainDataStream& vRecv)
 {
     // lite mode is not supported
     if (fLiteMode) return;
@@ -154,7 +154,7 @@ public:
     void Sync(CNode* node, uint256 nProp, bool fPartial = false);
 
     void Calculate();
-    void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+    void ProcessMessage(CNode* pfrom, std::string& strCommand, CPlainDataStream& vRecv);
     void NewBlock();
     CCommunityProposal* FindProposal(const std::string& strProposalName);
     CCommunityProposal* FindProposal(uint256 nHash);
@@ -634,12 +634,23 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
 
     // verify that sig time is legit in past
     // should be at least not earlier than block when BITG collateral tx got MASTERNODE_MIN_CONFIRMATIONS
-    uint256 hashBlock = 0;
-    CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second) {
-        CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 PIVX tx -> 1 confirmation
+    // the collateral is unspent, so its height is in the UTXO set even if its block was pruned
+    CBlockIndex* pMNIndex = nullptr;
+    {
+        LOCK(cs_main);
+        const CCoins* coins = pcoinsTip->AccessCoins(vin.prevout.hash);
+        if (coins && coins->nHeight > 0 && coins->nHeight <= chainActive.Height())
+            pMNIndex = chainActive[coins->nHeight];
+    }
+    if (pMNIndex == nullptr) {
+        uint256 hashBlock = 0;
+        CTransaction tx2;
+        GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end())
+            pMNIndex = (*mi).second;
+    }
+    if (pMNIndex != nullptr) {                                                                       // block for 1000 PIVX tx -> 1 confirmation
         CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
         if (pConfIndex->GetBlockTime() > sigTime) {
             LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
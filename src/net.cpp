@@ -89,8 +89,8 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
-deque<pair<int64_t, CInv> > vRelayExpiration;
+map<uint256, CTransactionRef> mapRelay;
+deque<pair<int64_t, uint256> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
@@ -342,6 +342,8 @@ uint64_t CNode::nTotalBytesRecv = 0;
 uint64_t CNode::nTotalBytesSent = 0;
 CCriticalSection CNode::cs_totalBytesRecv;
 CCriticalSection CNode::cs_totalBytesSent;
+mapMsgCmdStats CNode::mapTotalMsgStats;
+CCriticalSection CNode::cs_totalMsgStats;
 
 CNode* FindNode(const CNetAddr& ip)
 {
@@ -668,6 +670,11 @@ void CNode::copyStats(CNodeStats& stats)
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
+
+    {
+        LOCK(cs_msgStats);
+        stats.mapMsgStats = mapMsgStats;
+    }
 }
 #undef X
 
@@ -1805,14 +1812,14 @@ void CExplicitNetCleanup::callCleanup()
 
 void RelayTransaction(const CTransaction& tx)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << tx;
-    RelayTransaction(tx, ss);
+    // Share the mempool's copy, which is where relayed transactions come from
+    CTransactionRef ptx = mempool.get(tx.GetHash());
+    RelayTransaction(ptx ? ptx : MakeTransactionRef(tx));
 }
 
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
+void RelayTransaction(const CTransactionRef& ptx)
 {
+    const CTransaction& tx = *ptx;
     CInv inv(MSG_TX, tx.GetHash());
     {
         LOCK(cs_mapRelay);
@@ -1822,9 +1829,9 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        // Keep the transaction for peers that ask for it after it has left the mempool
+        mapRelay.insert(std::make_pair(tx.GetHash(), ptx));
+        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, tx.GetHash()));
     }
     LOCK(cs_vNodes);
     BOOST_FOREACH (CNode* pnode, vNodes) {
@@ -1887,6 +1894,68 @@ uint64_t CNode::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+// Map a wire command onto its statistics bucket. Peers choose the command
+// string, so only known commands get their own entry to keep the maps bounded.
+static const std::string& GetMessageStatsCommand(const std::string& strCommand)
+{
+    static const std::set<std::string> setKnownCommands(GetAllNetMessageTypes().begin(), GetAllNetMessageTypes().end());
+    static const std::string strOther(NET_MESSAGE_COMMAND_OTHER);
+
+    std::set<std::string>::const_iterator it = setKnownCommands.find(strCommand);
+    return it != setKnownCommands.end() ? *it : strOther;
+}
+
+void CNode::RecordMessageSent(const std::string& strCommand, uint64_t nBytes)
+{
+    const std::string& strKey = GetMessageStatsCommand(strCommand);
+    {
+        LOCK(cs_msgStats);
+        CNetMessageStats& stats = mapMsgStats[strKey];
+        stats.nSendBytes += nBytes;
+        stats.nSendMsgs++;
+    }
+    LOCK(cs_totalMsgStats);
+    CNetMessageStats& total = mapTotalMsgStats[strKey];
+    total.nSendBytes += nBytes;
+    total.nSendMsgs++;
+}
+
+void CNode::RecordMessageRecv(const std::string& strCommand, uint64_t nBytes)
+{
+    const std::string& strKey = GetMessageStatsCommand(strCommand);
+    {
+        LOCK(cs_msgStats);
+        CNetMessageStats& stats = mapMsgStats[strKey];
+        stats.nRecvBytes += nBytes;
+        stats.nRecvMsgs++;
+    }
+    LOCK(cs_totalMsgStats);
+    CNetMessageStats& total = mapTotalMsgStats[strKey];
+    total.nRecvBytes += nBytes;
+    total.nRecvMsgs++;
+}
+
+void CNode::RecordMessageProcessed(const std::string& strCommand, int64_t nTimeMicros)
+{
+    const std::string& strKey = GetMessageStatsCommand(strCommand);
+    {
+        LOCK(cs_msgStats);
+        CNetMessageStats& stats = mapMsgStats[strKey];
+        stats.nProcessTime += nTimeMicros;
+        stats.nProcessTimeMax = std::max(stats.nProcessTimeMax, nTimeMicros);
+    }
+    LOCK(cs_totalMsgStats);
+    CNetMessageStats& total = mapTotalMsgStats[strKey];
+    total.nProcessTime += nTimeMicros;
+    total.nProcessTimeMax = std::max(total.nProcessTimeMax, nTimeMicros);
+}
+
+void CNode::GetTotalMessageStats(mapMsgCmdStats& mapStats)
+{
+    LOCK(cs_totalMsgStats);
+    mapStats = mapTotalMsgStats;
+}
+
 void CNode::Fuzz(int nChance)
 {
     if (!fSuccessfullyConnected) return; // Don't fuzz initial handshake
@@ -2159,6 +2228,9 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
+    const char* pchCommand = &ssSend[MESSAGE_START_SIZE];
+    RecordMessageSent(std::string(pchCommand, strnlen(pchCommand, CMessageHeader::COMMAND_SIZE)), ssSend.size());
+
     std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
     ssSend.GetAndClear(*it);
     nSendSize += (*it).size();
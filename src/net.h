@@ -14,6 +14,7 @@
 #include "limitedmap.h"
 #include "mruset.h"
 #include "netbase.h"
+#include "primitives/transaction.h"
 #include "protocol.h"
 #include "random.h"
 #include "streams.h"
@@ -132,8 +133,8 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+extern std::map<uint256, CTransactionRef> mapRelay;
+extern std::deque<std::pair<int64_t, uint256> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
@@ -151,6 +152,22 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
+/** Traffic and handler-time counters for a single P2P message command */
+class CNetMessageStats
+{
+public:
+    uint64_t nSendBytes;
+    uint64_t nSendMsgs;
+    uint64_t nRecvBytes;
+    uint64_t nRecvMsgs;
+    int64_t nProcessTime;    // cumulative time (in microseconds) spent in ProcessMessage
+    int64_t nProcessTimeMax; // longest single ProcessMessage run (in microseconds)
+
+    CNetMessageStats() : nSendBytes(0), nSendMsgs(0), nRecvBytes(0), nRecvMsgs(0), nProcessTime(0), nProcessTimeMax(0) {}
+};
+
+typedef std::map<std::string, CNetMessageStats> mapMsgCmdStats;
+
 class CNodeStats
 {
 public:
@@ -171,6 +188,7 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    mapMsgCmdStats mapMsgStats;
 };
 
 
@@ -179,11 +197,11 @@ class CNetMessage
 public:
     bool in_data; // parsing header (false) or data (true)
 
-    CDataStream hdrbuf; // partially received header
+    CPlainDataStream hdrbuf; // partially received header
     CMessageHeader hdr; // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv; // received message data
+    CPlainDataStream vRecv; // received message data
     unsigned int nDataPos;
 
     int64_t nTime; // time (in microseconds) of message receipt.
@@ -329,6 +347,10 @@ public:
     NodeId id;
 
 protected:
+    // Per-command network usage of this peer
+    mapMsgCmdStats mapMsgStats;
+    CCriticalSection cs_msgStats;
+
     // Denial-of-service detection/prevention
     // Key is IP address, value is banned-until-time
     static banmap_t setBanned;
@@ -381,6 +403,8 @@ private:
     static CCriticalSection cs_totalBytesSent;
     static uint64_t nTotalBytesRecv;
     static uint64_t nTotalBytesSent;
+    static CCriticalSection cs_totalMsgStats;
+    static mapMsgCmdStats mapTotalMsgStats;
 
     CNode(const CNode&);
     void operator=(const CNode&);
@@ -721,6 +745,13 @@ public:
 
     static uint64_t GetTotalBytesRecv();
     static uint64_t GetTotalBytesSent();
+
+    // Per-command network stats, unknown commands are accounted as NET_MESSAGE_COMMAND_OTHER
+    void RecordMessageSent(const std::string& strCommand, uint64_t nBytes);
+    void RecordMessageRecv(const std::string& strCommand, uint64_t nBytes);
+    void RecordMessageProcessed(const std::string& strCommand, int64_t nTimeMicros);
+
+    static void GetTotalMessageStats(mapMsgCmdStats& mapStats);
 };
 
 class CExplicitNetCleanup
@@ -731,7 +762,7 @@ public:
 
 class CTransaction;
 void RelayTransaction(const CTransaction& tx);
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+void RelayTransaction(const CTransactionRef& ptx);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll = false);
 void RelayInv(CInv& inv);
 
@@ -13,6 +13,7 @@
 #include "uint256.h"
 
 #include <list>
+#include <memory>
 
 class CTransaction;
 
@@ -273,6 +274,16 @@ public:
     std::string ToString() const;
 };
 
+/**
+ * A transaction shared by everything that holds on to it: blocks, the mempool,
+ * relay and orphan maps. It is immutable, so changing one means building a
+ * CMutableTransaction and a new CTransactionRef from that.
+ */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
+template <typename Tx>
+static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+
 /** A mutable version of CTransaction. */
 struct CMutableTransaction
 {
@@ -36,6 +36,49 @@ static const char* ppszTypeName[] =
         "mn community proposal",
         "mn community proposal vote"};
 
+/** All known P2P message commands, used to bucket per-command network statistics. */
+static const char* ppszMessageTypes[] =
+    {
+        "version",
+        "verack",
+        "addr",
+        "getaddr",
+        "inv",
+        "getdata",
+        "notfound",
+        "getblocks",
+        "getheaders",
+        "headers",
+        "block",
+        "merkleblock",
+        "tx",
+        "mempool",
+        "ping",
+        "pong",
+        "alert",
+        "reject",
+        "filterload",
+        "filteradd",
+        "filterclear",
+        "spork",
+        "getsporks",
+        "ix",
+        "txlvote",
+        "mnb",
+        "mnp",
+        "mnw",
+        "mnget",
+        "dseg",
+        "ssc",
+        "mprop",
+        "mvote",
+        "mnvs",
+        "fbs",
+        "fbvote",
+        "mcprop",
+        "mcvote",
+        "mncvs"};
+
 CMessageHeader::CMessageHeader()
 {
     memcpy(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE);
@@ -153,6 +196,12 @@ const char* CInv::GetCommand() const
     return ppszTypeName[type];
 }
 
+const std::vector<std::string>& GetAllNetMessageTypes()
+{
+    static const std::vector<std::string> vAllNetMessageTypes(ppszMessageTypes, ppszMessageTypes + ARRAYLEN(ppszMessageTypes));
+    return vAllNetMessageTypes;
+}
+
 std::string CInv::ToString() const
 {
     return strprintf("%s %s", GetCommand(), hash.ToString());
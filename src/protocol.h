@@ -20,6 +20,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #define MESSAGE_START_SIZE 4
 
@@ -66,6 +67,12 @@ public:
     unsigned int nChecksum;
 };
 
+/** Get a vector of all valid message types (see ppszMessageTypes in protocol.cpp) */
+const std::vector<std::string>& GetAllNetMessageTypes();
+
+/** Bucket used for per-command statistics of message types not in GetAllNetMessageTypes() */
+#define NET_MESSAGE_COMMAND_OTHER "*other*"
+
 /** nServices flags */
 enum {
     NODE_NETWORK = (1 << 0),
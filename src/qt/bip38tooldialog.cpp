@@ -242,7 +242,11 @@ void Bip38ToolDialog::on_importAddressButton_DEC_clicked()
 
         // whenever a key is imported, we need to scan the whole chain
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
-        pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+        if (pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true) < 0) {
+            ui->statusLabel_DEC->setStyleSheet("QLabel { color: red; }");
+            ui->statusLabel_DEC->setText(tr("Key added, but the wallet is already rescanning. Restart with -rescan to find its transactions"));
+            return;
+        }
     }
 
     ui->statusLabel_DEC->setStyleSheet("QLabel { color: green; }");
@@ -101,6 +101,20 @@ static std::string makeHTMLTable(const std::string* pCells, int nRows, int nColu
     return Table;
 }
 
+static bool IsHighlighted(const CScript& Script, const CScript& Highlight)
+{
+    if (Highlight.empty())
+        return false;
+    if (Script == Highlight)
+        return true;
+
+    // Pay-to-pubkey outputs belong to the address of their key
+    uint160 HashScript, HashHighlight;
+    int TypeScript, TypeHighlight;
+    return GetAddressIndexKey(Script, HashScript, TypeScript) && GetAddressIndexKey(Highlight, HashHighlight, TypeHighlight) &&
+           HashScript == HashHighlight && TypeScript == TypeHighlight;
+}
+
 static std::string TxToRow(const CTransaction& tx, const CScript& Highlight = CScript(), const std::string& Prepend = std::string(), int64_t* pSum = nullptr)
 {
     std::string InAmounts, InAddresses, OutAmounts, OutAddresses;
@@ -112,8 +126,9 @@ static std::string TxToRow(const CTransaction& tx, const CScript& Highlight = CS
         } else {
             CTxOut PrevOut = getPrevOut(tx.vin[j].prevout);
             InAmounts += ValueToString(PrevOut.nValue);
-            InAddresses += ScriptToString(PrevOut.scriptPubKey, false, PrevOut.scriptPubKey == Highlight).c_str();
-            if (PrevOut.scriptPubKey == Highlight)
+            bool fHighlight = IsHighlighted(PrevOut.scriptPubKey, Highlight);
+            InAddresses += ScriptToString(PrevOut.scriptPubKey, false, fHighlight).c_str();
+            if (fHighlight)
                 Delta -= PrevOut.nValue;
         }
         if (j + 1 != tx.vin.size()) {
@@ -124,8 +139,9 @@ static std::string TxToRow(const CTransaction& tx, const CScript& Highlight = CS
     for (unsigned int j = 0; j < tx.vout.size(); j++) {
         CTxOut Out = tx.vout[j];
         OutAmounts += ValueToString(Out.nValue);
-        OutAddresses += ScriptToString(Out.scriptPubKey, false, Out.scriptPubKey == Highlight);
-        if (Out.scriptPubKey == Highlight)
+        bool fHighlight = IsHighlighted(Out.scriptPubKey, Highlight);
+        OutAddresses += ScriptToString(Out.scriptPubKey, false, fHighlight);
+        if (fHighlight)
             Delta += Out.nValue;
         if (j + 1 != tx.vout.size()) {
             OutAmounts += "<br/>";
@@ -166,10 +182,13 @@ CTxOut getPrevOut(const COutPoint& out)
 
 void getNextIn(const COutPoint& Out, uint256& Hash, unsigned int& n)
 {
-    // Hash = 0;
-    // n = 0;
-    // if (paddressmap)
-    //    paddressmap->ReadNextIn(Out, Hash, n);
+    Hash = 0;
+    n = 0;
+    CSpentIndexValue Spent;
+    if (GetSpentIndex(CSpentIndexKey(Out.hash, Out.n), Spent)) {
+        Hash = Spent.txid;
+        n = Spent.inputIndex;
+    }
 }
 
 const CBlockIndex* getexplorerBlockIndex(int64_t height)
@@ -210,7 +229,7 @@ std::string BlockToString(CBlockIndex* pBlock)
 
     std::string TxContent = table + makeHTMLTableRow(TxLabels, sizeof(TxLabels) / sizeof(std::string));
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
-        const CTransaction& tx = block.vtx[i];
+        const CTransaction& tx = *block.vtx[i];
         TxContent += TxToRow(tx);
 
         CAmount In = getTxIn(tx);
@@ -330,7 +349,7 @@ std::string TxToString(uint256 BlockHash, const CTransaction& tx)
         const CTxOut& Out = tx.vout[i];
         uint256 HashNext = uint256S("0");
         unsigned int nNext = 0;
-        bool fAddrIndex = false;
+        bool fAddrIndex = fSpentIndex;
         getNextIn(COutPoint(TxHash, i), HashNext, nNext);
         std::string OutputsContentCells[] =
             {
@@ -378,6 +397,9 @@ std::string TxToString(uint256 BlockHash, const CTransaction& tx)
     return Content;
 }
 
+/** Maximum number of transactions listed for an address */
+static const size_t MAX_EXPLORER_ADDRESS_TXS = 1000;
+
 std::string AddressToString(const CBitcoinAddress& Address)
 {
     std::string TxLabels[] =
@@ -392,37 +414,49 @@ std::string AddressToString(const CBitcoinAddress& Address)
             _("Balance")};
     std::string TxContent = table + makeHTMLTableRow(TxLabels, sizeof(TxLabels) / sizeof(std::string));
 
-    std::set<COutPoint> PrevOuts;
-    /*
-    CScript AddressScript;
-    AddressScript.SetDestination(Address.Get());
+    uint160 AddressHash;
+    int AddressType;
+    if (!fAddressIndex || !GetAddressIndexKey(Address.Get(), AddressHash, AddressType))
+        return ""; // it will take too long to find transactions by address
+    std::vector<std::pair<CAddressIndexKey, CAmount> > AddressIndex;
+    if (!GetAddressIndex(AddressHash, AddressType, AddressIndex))
+        return "";
 
-    CAmount Sum = 0;
-    bool fAddrIndex = false;
+    // Entries are ordered by height and position in the block, so all entries
+    // of a transaction are adjacent. Only the most recent transactions are
+    // listed; the balance column still starts from the full history.
+    std::vector<size_t> TxStarts;
+    for (size_t i = 0; i < AddressIndex.size(); i++)
+        if (i == 0 || AddressIndex[i].first.txhash != AddressIndex[i - 1].first.txhash)
+            TxStarts.push_back(i);
+    size_t First = TxStarts.size() > MAX_EXPLORER_ADDRESS_TXS ? TxStarts[TxStarts.size() - MAX_EXPLORER_ADDRESS_TXS] : 0;
 
-    if (!fAddrIndex)
-        return ""; // it will take too long to find transactions by address
-    else
-    {
-        std::vector<CDiskTxPos> Txs;
-        paddressmap->GetTxs(Txs, AddressScript.GetID());
-        BOOST_FOREACH (const CDiskTxPos& pos, Txs)
+    CAmount Sum = 0;
+    for (size_t i = 0; i < First; i++)
+        Sum += AddressIndex[i].second;
+
+    CScript AddressScript = GetScriptForDestination(Address.Get());
+    std::vector<std::string> Rows;
+    for (size_t i = First; i < AddressIndex.size(); i++) {
+        const CAddressIndexKey& Key = AddressIndex[i].first;
+        if (i > First && Key.txhash == AddressIndex[i - 1].first.txhash)
+            continue;
+        CTransaction tx;
+        uint256 hashBlock;
+        if (!GetTransaction(Key.txhash, tx, hashBlock, true))
+            continue;
+        std::string Prepend = "<a href=\"" + itostr(Key.blockHeight) + "\">" + itostr(Key.blockHeight) + "</a>";
         {
-            CTransaction tx;
-            CBlock block;
-            uint256 bhash = block.GetHash();
-            GetTransaction(pos.nTxOffset, tx, bhash);
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
-            if (mi == mapBlockIndex.end())
-                continue;
-            CBlockIndex* pindex = (*mi).second;
-            if (!pindex || !chainActive.Contains(pindex))
-                continue;
-            std::string Prepend = "<a href=\"" + itostr(pindex->nHeight) + "\">" + TimeToString(pindex->nTime) + "</a>";
-            TxContent += TxToRow(tx, AddressScript, Prepend, &Sum);
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && mi->second)
+                Prepend = "<a href=\"" + itostr(Key.blockHeight) + "\">" + TimeToString(mi->second->nTime) + "</a>";
         }
+        Rows.push_back(TxToRow(tx, AddressScript, Prepend, &Sum));
     }
-    */
+    // Newest first
+    for (std::vector<std::string>::reverse_iterator it = Rows.rbegin(); it != Rows.rend(); ++it)
+        TxContent += *it;
     TxContent += "</table>";
 
     std::string Content;
@@ -25,7 +25,7 @@ class CBlockTreeDB;
 std::string getexplorerBlockHash(int64_t);
 const CBlockIndex* getexplorerBlockIndex(int64_t);
 CTxOut getPrevOut(const COutPoint& out);
-void getNextIn(const COutPoint* Out, uint256* Hash, unsigned int n);
+void getNextIn(const COutPoint& Out, uint256& Hash, unsigned int& n);
 
 class BlockExplorer : public QMainWindow
 {
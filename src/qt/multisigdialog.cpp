@@ -235,7 +235,11 @@ void MultisigDialog::on_importAddressButton_clicked(){
     addMultisig(stoi(vRedeem[0]), keys);
 
     // rescan to find txs associated with imported address
-    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+    if (pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true) < 0) {
+        ui->addMultisigStatus->setStyleSheet("QLabel { color: red; }");
+        ui->addMultisigStatus->setText(tr("Address imported, but the wallet is already rescanning. Restart with -rescan to find its transactions"));
+        return;
+    }
     pwalletMain->ReacceptWalletTransactions();
 }
 
@@ -741,7 +745,7 @@ void MultisigDialog::commitMultisigTx()
         if (!fHaveMempool && !fHaveChain) {
             // push to local node and sync with wallets
             CValidationState state;
-            if (!AcceptToMemoryPool(mempool, state, tx, false, nullptr, !fOverrideFees)) {
+            if (!AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), false, nullptr, !fOverrideFees)) {
                 if (state.IsInvalid())
                     throw runtime_error(strprintf("Transaction rejected - %i: %s", state.GetRejectCode(), state.GetRejectReason()));
                 else
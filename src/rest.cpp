@@ -6,7 +6,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "chainparams.h"
 #include "core_io.h"
+#include "crypto/common.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
@@ -18,6 +20,8 @@
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <memory>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/dynamic_bitset.hpp>
 
@@ -26,6 +30,10 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const int MAX_REST_BLOCKS_RANGE = 10000;    //max number of blocks streamed by one /rest/blocks/ request
+static const int MAX_REST_HEADERS_RANGE = 100000;  //max number of headers streamed by one range /rest/headers/ request
+static const size_t REST_STREAM_CHUNK_SIZE = 64 * 1024;
+static const size_t MAX_REST_STREAM_PENDING = 1024 * 1024; //max bytes queued for a slow client before reading on
 
 enum RetFormat {
     RF_UNDEF,
@@ -117,6 +125,200 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+/**
+ * Parse "<start-height>/<count>" into the active chain entries of that range.
+ * The range is cut off at the chain tip.
+ */
+static bool ParseHeightRange(HTTPRequest* req, const vector<string>& path, int nMaxCount, std::vector<const CBlockIndex*>& vIndex)
+{
+    int32_t nStart, nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nStart) || !ParseInt32(path[1], &nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid range. Use <start-height>/<count>.<bin|hex>.");
+    if (nCount < 1 || nCount > nMaxCount)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Count out of range (1-%d): %s", nMaxCount, path[1]));
+
+    // CBlockIndex entries are never freed, so the pointers stay valid after cs_main is released
+    LOCK(cs_main);
+    if (nStart < 0 || nStart > chainActive.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Start height out of range: " + path[0]);
+    int nEnd = std::min(chainActive.Height() + 1, nStart + nCount);
+    vIndex.reserve(nEnd - nStart);
+    for (int nHeight = nStart; nHeight < nEnd; nHeight++)
+        vIndex.push_back(chainActive[nHeight]);
+    return true;
+}
+
+/**
+ * Sends the output of a range request: the reply is started on the first
+ * chunk, and the producer is paused while too much data waits for the client.
+ */
+class RESTRangeStream
+{
+public:
+    RESTRangeStream(HTTPRequest* reqIn, RetFormat rfIn) : req(reqIn), rf(rfIn) {}
+
+    //! Returns false if the client went away
+    bool Write(const char* pch, size_t nSize)
+    {
+        strBuffer.append(pch, nSize);
+        if (strBuffer.size() >= REST_STREAM_CHUNK_SIZE)
+            return Flush();
+        return true;
+    }
+
+    bool Flush()
+    {
+        if (strBuffer.empty())
+            return true;
+        if (!req->IsChunked()) {
+            req->WriteHeader("Content-Type", rf == RF_HEX ? "text/plain" : "application/octet-stream");
+            req->WriteReplyStart(HTTP_OK);
+        }
+        req->WriteReplyChunk(rf == RF_HEX ? HexStr(strBuffer.begin(), strBuffer.end()) : strBuffer);
+        strBuffer.clear();
+        return req->WaitForChunkBuffer(MAX_REST_STREAM_PENDING);
+    }
+
+    void Finish()
+    {
+        if (rf == RF_HEX)
+            strBuffer += "\n";
+        Flush();
+        req->WriteReplyEnd();
+    }
+
+    //! Drop the connection so the client can tell the reply is incomplete
+    void Abort()
+    {
+        req->WriteReplyAbort();
+    }
+
+private:
+    HTTPRequest* req;
+    RetFormat rf;
+    std::string strBuffer;
+};
+
+static bool rest_headers_range(HTTPRequest* req, RetFormat rf, const vector<string>& path)
+{
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    std::vector<const CBlockIndex*> vIndex;
+    if (!ParseHeightRange(req, path, MAX_REST_HEADERS_RANGE, vIndex))
+        return false;
+
+    // Headers come from the in-memory block index; the fields read here never change
+    RESTRangeStream stream(req, rf);
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH (const CBlockIndex* pindex, vIndex) {
+        ssHeader << pindex->GetBlockHeader();
+        bool fOk = stream.Write(&ssHeader[0], ssHeader.size());
+        ssHeader.clear();
+        if (!fOk) {
+            // The client stopped reading; don't end the reply as if it were complete
+            stream.Abort();
+            return false;
+        }
+    }
+    stream.Finish();
+    return true;
+}
+
+static bool rest_blocks_range(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+    std::vector<const CBlockIndex*> vIndex;
+    if (!ParseHeightRange(req, path, MAX_REST_BLOCKS_RANGE, vIndex))
+        return false;
+
+    // The files stay pinned until the reply is done, so pruning can't delete
+    // them under the reader
+    std::vector<CDiskBlockPos> vPos;
+    vPos.reserve(vIndex.size());
+    std::unique_ptr<CBlockFilesPin> pin;
+    {
+        LOCK(cs_main);
+        std::set<int> setFiles;
+        BOOST_FOREACH (const CBlockIndex* pindex, vIndex) {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+            vPos.push_back(pindex->GetBlockPos());
+            setFiles.insert(vPos.back().nFile);
+        }
+        pin.reset(new CBlockFilesPin(setFiles));
+    }
+
+    // Copy the serialized blocks straight from the block files. Every block is
+    // preceded on disk by the network magic and its size; consecutive blocks
+    // in the same file are read through one open file.
+    RESTRangeStream stream(req, rf);
+    std::vector<char> vBuf(REST_STREAM_CHUNK_SIZE);
+    FILE* file = nullptr;
+    int nFile = -1;
+    bool fReadOk = true;
+    bool fClientOk = true;
+    BOOST_FOREACH (const CDiskBlockPos& pos, vPos) {
+        if (pos.nFile != nFile) {
+            if (file)
+                fclose(file);
+            nFile = pos.nFile;
+            file = OpenBlockFile(CDiskBlockPos(nFile, 0), true);
+        }
+        unsigned char header[MESSAGE_START_SIZE + sizeof(uint32_t)];
+        if (!file || pos.nPos < sizeof(header) || fseek(file, pos.nPos - sizeof(header), SEEK_SET) != 0 ||
+            fread(header, 1, sizeof(header), file) != sizeof(header) ||
+            memcmp(header, Params().MessageStart(), MESSAGE_START_SIZE) != 0) {
+            LogPrintf("%s: failed to read block at file %d pos %u\n", __func__, pos.nFile, pos.nPos);
+            fReadOk = false;
+            break;
+        }
+        uint32_t nSize = ReadLE32(header + MESSAGE_START_SIZE);
+        if (nSize > MAX_BLOCK_SIZE) {
+            LogPrintf("%s: invalid block size %u at file %d pos %u\n", __func__, nSize, pos.nFile, pos.nPos);
+            fReadOk = false;
+            break;
+        }
+
+        while (nSize > 0 && fClientOk) {
+            size_t nRead = fread(vBuf.data(), 1, std::min((size_t)nSize, vBuf.size()), file);
+            if (nRead == 0) {
+                LogPrintf("%s: failed to read block at file %d pos %u\n", __func__, pos.nFile, pos.nPos);
+                fReadOk = false;
+                break;
+            }
+            nSize -= nRead;
+            fClientOk = stream.Write(vBuf.data(), nRead);
+        }
+        if (!fReadOk || !fClientOk)
+            break;
+    }
+    if (file)
+        fclose(file);
+
+    if (!fReadOk) {
+        if (!req->IsChunked())
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read block data");
+        stream.Abort();
+        return false;
+    }
+    if (!fClientOk) {
+        // The client stopped reading; don't end the reply as if it were complete
+        stream.Abort();
+        return false;
+    }
+    stream.Finish();
+    return true;
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -127,6 +329,10 @@ static bool rest_headers(HTTPRequest* req,
     vector<string> path;
     boost::split(path, params[0], boost::is_any_of("/"));
 
+    // /rest/headers/<start-height>/<count> streams a range of the active chain
+    if (path.size() == 2 && path[1].size() != 64)
+        return rest_headers_range(req, rf, path);
+
     if (path.size() != 2)
         return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
 
@@ -220,7 +426,7 @@ static bool rest_block(HTTPRequest* req,
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    CPlainDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
     ssBlock << block;
 
     switch (rf) {
@@ -600,6 +806,7 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blocks/", rest_blocks_range},
       {"/rest/getutxos", rest_getutxos},
 };
 
@@ -16,6 +16,7 @@
 #include "util.h"
 #include "utilmoneystr.h"
 
+#include <limits>
 #include <stdint.h>
 #include <univalue.h>
 
@@ -76,7 +77,18 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** The transaction as listed in a block's tx array */
+static UniValue blockTxToJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToUniv(tx, uint256(), objTx);
+    return objTx;
+}
+
+/** The fields of blockToJSON; with fTxs false the tx array is left null for the caller to write */
+static UniValue blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, bool fTxs)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", block.GetHash().GetHex()));
@@ -89,14 +101,11 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
-    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-        if (txDetails) {
-            UniValue objTx(UniValue::VOBJ);
-            TxToUniv(tx, uint256(), objTx);
-            txs.push_back(objTx);
-        } else
-            txs.push_back(tx.GetHash().GetHex());
+    UniValue txs;
+    if (fTxs) {
+        txs.setArray();
+        BOOST_FOREACH (const CTransactionRef& ptx, block.vtx)
+            txs.push_back(blockTxToJSON(*ptx, txDetails));
     }
     result.push_back(Pair("tx", txs));
     result.push_back(Pair("time", block.GetBlockTime()));
@@ -119,6 +128,11 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    return blockFieldsToJSON(block, blockindex, txDetails, true);
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -171,36 +185,39 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
 }
 
 
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    AssertLockHeld(mempool.cs);
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends) {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends) {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
-        }
+        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx)
+            o.push_back(Pair(entry.first.ToString(), mempoolEntryToJSON(entry.second)));
         return o;
     } else {
         vector<uint256> vtxid;
@@ -257,6 +274,40 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+void getrawmempool_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    // Only the verbose form is large enough to be worth streaming
+    if (params.size() != 1 || !params[0].get_bool()) {
+        writer.Value(getrawmempool(params, false));
+        return;
+    }
+
+    // The writer waits for a slow client, so the entries are looked up a
+    // batch at a time and written without the locks. Transactions that left
+    // the mempool in between are skipped.
+    vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+
+    writer.BeginObject();
+    vector<pair<uint256, UniValue> > vEntries;
+    for (size_t nStart = 0; nStart < vtxid.size(); nStart += RPC_STREAM_ENTRIES_PER_LOCK) {
+        {
+            LOCK2(cs_main, mempool.cs);
+            for (size_t i = nStart; i < std::min(vtxid.size(), nStart + RPC_STREAM_ENTRIES_PER_LOCK); i++) {
+                map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(vtxid[i]);
+                if (it != mempool.mapTx.end())
+                    vEntries.push_back(make_pair(it->first, mempoolEntryToJSON(it->second)));
+            }
+        }
+        for (const pair<uint256, UniValue>& entry : vEntries) {
+            writer.Key(entry.first.ToString());
+            writer.Value(entry.second);
+        }
+        vEntries.clear();
+    }
+    writer.EndObject();
+}
+
 UniValue getblockhash(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -283,6 +334,59 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockhashes(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getblockhashes high low\n"
+            "\nReturns array of hashes of blocks within the timestamp range provided (requires -timestampindex to be enabled).\n"
+
+            "\nArguments:\n"
+            "1. high         (numeric, required) The newer block timestamp\n"
+            "2. low          (numeric, required) The older block timestamp\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"hash\"         (string) The block hash\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockhashes", "1231614698 1231024505") + HelpExampleRpc("getblockhashes", "1231614698, 1231024505"));
+
+    int64_t nHigh = params[0].get_int64();
+    int64_t nLow = params[1].get_int64();
+    if (nLow < 0 || nHigh < nLow || nHigh > std::numeric_limits<unsigned int>::max())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid timestamp range");
+
+    std::vector<uint256> vHashes;
+    if (!GetTimestampIndex((unsigned int)nHigh, (unsigned int)nLow, vHashes))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH (const uint256& hash, vHashes)
+        result.push_back(hash.GetHex());
+    return result;
+}
+
+/** Look up and read the block getblock was asked for. Needs cs_main */
+static CBlockIndex* ReadGetBlockParam(const UniValue& params, CBlock& block)
+{
+    uint256 hash(ParseHashV(params[0].get_str(), "blockhash"));
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if (!ReadBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -326,23 +430,15 @@ UniValue getblock(const UniValue& params, bool fHelp)
 
     LOCK(cs_main);
 
-    uint256 hash(ParseHashV(params[0].get_str(), "blockhash"));
-
     bool fVerbose = true;
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex* pblockindex = ReadGetBlockParam(params, block);
 
     if (!fVerbose) {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        CPlainDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
@@ -351,6 +447,40 @@ UniValue getblock(const UniValue& params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+void getblock_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    // The non-verbose form is a single hex string
+    if (params.size() < 1 || params.size() > 2 || (params.size() > 1 && !params[1].get_bool())) {
+        writer.Value(getblock(params, false));
+        return;
+    }
+
+    // The tx array is written a transaction at a time, after cs_main is released
+    CBlock block;
+    UniValue result;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pblockindex = ReadGetBlockParam(params, block);
+        result = blockFieldsToJSON(block, pblockindex, false, false);
+    }
+
+    const vector<string>& vKeys = result.getKeys();
+    const vector<UniValue>& vValues = result.getValues();
+    writer.BeginObject();
+    for (unsigned int i = 0; i < vKeys.size(); i++) {
+        writer.Key(vKeys[i]);
+        if (vKeys[i] != "tx") {
+            writer.Value(vValues[i]);
+            continue;
+        }
+        writer.BeginArray();
+        BOOST_FOREACH (const CTransactionRef& ptx, block.vtx)
+            writer.Value(blockTxToJSON(*ptx, false));
+        writer.EndArray();
+    }
+    writer.EndObject();
+}
+
 UniValue getblockheader(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -408,7 +538,7 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
         throw runtime_error(
             "gettxoutsetinfo\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The statistics are maintained incrementally as blocks are connected and disconnected.\n"
 
             "\nResult:\n"
             "{\n"
@@ -417,7 +547,7 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"muhash\": \"hash\",            (string) Order-independent MuHash of all unspent outputs\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
@@ -429,14 +559,16 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
     if (pcoinsTip->GetStats(stats)) {
+        BlockMap::iterator mi = mapBlockIndex.find(stats.hashBlock);
+        if (mi != mapBlockIndex.end())
+            stats.nHeight = mi->second->nHeight;
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
@@ -550,6 +682,20 @@ UniValue verifychain(const UniValue& params, bool fHelp)
     return CVerifyDB().VerifyDB(pcoinsTip, nCheckLevel, nCheckDepth);
 }
 
+static UniValue VerifyDBProgressToJSON()
+{
+    static const char* const pszPhases[] = {"none", "checking", "reconnecting", "done", "failed", "interrupted"};
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("status", pszPhases[verifyDBProgress.nPhase]));
+    obj.push_back(Pair("checklevel", (int)verifyDBProgress.nCheckLevel));
+    obj.push_back(Pair("height", (int)verifyDBProgress.nHeight));
+    obj.push_back(Pair("blocks", (int)verifyDBProgress.nBlocks));
+    obj.push_back(Pair("total", (int)verifyDBProgress.nBlocksTotal));
+    if (verifyDBProgress.nResumeHeight >= 0)
+        obj.push_back(Pair("resumeheight", (int)verifyDBProgress.nResumeHeight));
+    return obj;
+}
+
 UniValue getblockchaininfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -565,21 +711,61 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
-            "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainwork\": \"xxxx\",    (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
+            "  \"verifydb\": {             (json object) the running or last block database verification (-checkblocks, verifychain)\n"
+            "     \"status\": \"xxxx\",      (string) none, checking, reconnecting, done, failed or interrupted\n"
+            "     \"checklevel\": n,        (numeric) the check level\n"
+            "     \"height\": xxxxxx,       (numeric) the block being verified\n"
+            "     \"blocks\": xxxxxx,       (numeric) the blocks verified in this phase\n"
+            "     \"total\": xxxxxx,        (numeric) the blocks to verify in this phase\n"
+            "     \"resumeheight\": xxxxxx  (numeric) blocks from this height up were checked before a restart (only present when resumed)\n"
+            "  }\n"
             "}\n"
+            "\nWhile blocks are being verified the chain fields describe the tip the verification started from.\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
 
-    LOCK(cs_main);
-
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain", Params().NetworkIDString()));
-    obj.push_back(Pair("blocks", (int)chainActive.Height()));
-    obj.push_back(Pair("headers", pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash", chainActive.Tip()->GetBlockHash().GetHex()));
-    obj.push_back(Pair("difficulty", (double)GetDifficulty()));
-    obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
-    obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+
+    // VerifyDB holds cs_main until it is done and puts the tip back where it
+    // was, answer from the chain state it recorded when it started meanwhile
+    bool fVerifying;
+    {
+        TRY_LOCK(cs_main, lockMain);
+        int nPhase = verifyDBProgress.nPhase;
+        fVerifying = !lockMain && (nPhase == CVerifyDBProgress::VERIFY_CHECKING || nPhase == CVerifyDBProgress::VERIFY_RECONNECTING);
+    }
+    CBlockIndex* pindexTip;
+    int nHeaders, nPruneHeight = 0;
+    if (fVerifying) {
+        pindexTip = verifyDBProgress.pindexTip;
+        nHeaders = verifyDBProgress.nHeaders;
+        nPruneHeight = verifyDBProgress.nPruneHeight;
+    } else {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+        nHeaders = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+        if (fPruneMode) {
+            CBlockIndex* block = pindexTip;
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+                block = block->pprev;
+            nPruneHeight = block->nHeight;
+        }
+    }
+
+    obj.push_back(Pair("blocks", (int)pindexTip->nHeight));
+    obj.push_back(Pair("headers", nHeaders));
+    obj.push_back(Pair("bestblockhash", pindexTip->GetBlockHash().GetHex()));
+    obj.push_back(Pair("difficulty", (double)GetDifficulty(pindexTip)));
+    obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(pindexTip)));
+    obj.push_back(Pair("chainwork", pindexTip->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode)
+        obj.push_back(Pair("pruneheight", nPruneHeight));
+    obj.push_back(Pair("verifydb", VerifyDBProgressToJSON()));
     return obj;
 }
 
@@ -637,9 +823,9 @@ UniValue getchaintips(const UniValue& params, bool fHelp)
        known blocks, and successively remove blocks that appear as pprev
        of another block.  */
     std::set<const CBlockIndex*, CompareBlocksByHeight> setTips;
-    BOOST_FOREACH (const PAIRTYPE(const uint256, CBlockIndex*) & item, mapBlockIndex)
+    BOOST_FOREACH (const BlockMap::value_type& item, mapBlockIndex)
         setTips.insert(item.second);
-    BOOST_FOREACH (const PAIRTYPE(const uint256, CBlockIndex*) & item, mapBlockIndex) {
+    BOOST_FOREACH (const BlockMap::value_type& item, mapBlockIndex) {
         const CBlockIndex* pprev = item.second->pprev;
         if (pprev)
             setTips.erase(pprev);
@@ -727,7 +913,8 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
 
         CAmount nValueIn = 0;
         CAmount nValueOut = 0;
-        for (const CTransaction& tx : block.vtx) {
+        for (const CTransactionRef& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
             if (tx.IsCoinBase() || tx.IsCoinStake())
                 continue;
 
@@ -49,6 +49,13 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getbalance", 1},
         {"getbalance", 2},
         {"getblockhash", 0},
+        {"getblockhashes", 0},
+        {"getblockhashes", 1},
+        {"getaddressbalance", 0},
+        {"getaddresstxids", 0},
+        {"getaddressutxos", 0},
+        {"getaddressmempool", 0},
+        {"getspentinfo", 0},
         {"move", 2},
         {"move", 3},
         {"sendfrom", 2},
@@ -18,6 +18,7 @@
 #include <univalue.h>
 
 #include <fstream>
+#include <functional>
 using namespace std;
 
 void budgetToJSON(CBudgetProposal* pbudgetProposal, UniValue& bObj)
@@ -731,6 +732,20 @@ UniValue getbudgetprojection(const UniValue& params, bool fHelp)
     return ret;
 }
 
+/** Pass the getbudgetinfo entry of every proposal to show to fnEntry */
+static void BudgetInfoEntries(const std::string& strShow, const std::function<void(const UniValue&)>& fnEntry)
+{
+    std::vector<CBudgetProposal*> winningProps = budget.GetAllProposals();
+    BOOST_FOREACH (CBudgetProposal* pbudgetProposal, winningProps) {
+        if (strShow == "valid" && !pbudgetProposal->fValid) continue;
+
+        UniValue bObj(UniValue::VOBJ);
+        budgetToJSON(pbudgetProposal, bObj);
+
+        fnEntry(bObj);
+    }
+}
+
 UniValue getbudgetinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -783,17 +798,22 @@ UniValue getbudgetinfo(const UniValue& params, bool fHelp)
         return ret;
     }
 
-    std::vector<CBudgetProposal*> winningProps = budget.GetAllProposals();
-    BOOST_FOREACH (CBudgetProposal* pbudgetProposal, winningProps) {
-        if (strShow == "valid" && !pbudgetProposal->fValid) continue;
+    BudgetInfoEntries(strShow, [&ret](const UniValue& bObj) { ret.push_back(bObj); });
 
-        UniValue bObj(UniValue::VOBJ);
-        budgetToJSON(pbudgetProposal, bObj);
+    return ret;
+}
 
-        ret.push_back(bObj);
+void getbudgetinfo_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    // A single proposal is small
+    if (params.size() != 0) {
+        writer.Value(getbudgetinfo(params, false));
+        return;
     }
 
-    return ret;
+    writer.BeginArray();
+    BudgetInfoEntries("valid", [&writer](const UniValue& bObj) { writer.Value(bObj); });
+    writer.EndArray();
 }
 
 UniValue mnbudgetrawvote(const UniValue& params, bool fHelp)
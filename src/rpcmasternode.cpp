@@ -18,6 +18,7 @@
 
 #include <boost/tokenizer.hpp>
 #include <fstream>
+#include <functional>
 
 
 void SendMoney(const CTxDestination& address, CAmount nValue, CWalletTx& wtxNew, AvailableCoinsType coin_type = ALL_COINS)
@@ -193,45 +194,14 @@ UniValue masternode(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
-UniValue listmasternodes(const UniValue& params, bool fHelp)
+/** Pass the listmasternodes entry of every masternode matching strFilter to fnEntry; false if there is no chain yet */
+static bool ListMasternodeEntries(const std::string& strFilter, const std::function<void(const UniValue&)>& fnEntry)
 {
-    std::string strFilter = "";
-
-    if (params.size() == 1) strFilter = params[0].get_str();
-
-    if (fHelp || (params.size() > 1))
-        throw runtime_error(
-            "listmasternodes ( \"filter\" )\n"
-            "\nGet a ranked list of masternodes\n"
-
-            "\nArguments:\n"
-            "1. \"filter\"    (string, optional) Filter search text. Partial match by txhash, status, or addr.\n"
-
-            "\nResult:\n"
-            "[\n"
-            "  {\n"
-            "    \"rank\": n,           (numeric) Masternode Rank (or 0 if not enabled)\n"
-            "    \"txhash\": \"hash\",    (string) Collateral transaction hash\n"
-            "    \"outidx\": n,         (numeric) Collateral transaction output index\n"
-            "    \"status\": s,         (string) Status (ENABLED/EXPIRED/REMOVE/etc)\n"
-            "    \"addr\": \"addr\",      (string) Masternode BITG address\n"
-            "    \"version\": v,        (numeric) Masternode protocol version\n"
-            "    \"lastseen\": ttt,     (numeric) The time in seconds since epoch (Jan 1 1970 GMT) of the last seen\n"
-            "    \"activetime\": ttt,   (numeric) The time in seconds since epoch (Jan 1 1970 GMT) masternode has been active\n"
-            "    \"lastpaid\": ttt,     (numeric) The time in seconds since epoch (Jan 1 1970 GMT) masternode was last paid\n"
-            "  }\n"
-            "  ,...\n"
-            "]\n"
-
-            "\nExamples:\n" +
-            HelpExampleCli("listmasternodes", "") + HelpExampleRpc("listmasternodes", ""));
-
-    UniValue ret(UniValue::VARR);
     int nHeight;
     {
         LOCK(cs_main);
         CBlockIndex* pindex = chainActive.Tip();
-        if(!pindex) return 0;
+        if(!pindex) return false;
         nHeight = pindex->nHeight;
     }
     std::vector<pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(nHeight);
@@ -266,13 +236,92 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
             obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
             obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
 
-            ret.push_back(obj);
+            fnEntry(obj);
         }
     }
 
+    return true;
+}
+
+UniValue listmasternodes(const UniValue& params, bool fHelp)
+{
+    std::string strFilter = "";
+
+    if (params.size() == 1) strFilter = params[0].get_str();
+
+    if (fHelp || (params.size() > 1))
+        throw runtime_error(
+            "listmasternodes ( \"filter\" )\n"
+            "\nGet a ranked list of masternodes\n"
+
+            "\nArguments:\n"
+            "1. \"filter\"    (string, optional) Filter search text. Partial match by txhash, status, or addr.\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"rank\": n,           (numeric) Masternode Rank (or 0 if not enabled)\n"
+            "    \"txhash\": \"hash\",    (string) Collateral transaction hash\n"
+            "    \"outidx\": n,         (numeric) Collateral transaction output index\n"
+            "    \"status\": s,         (string) Status (ENABLED/EXPIRED/REMOVE/etc)\n"
+            "    \"addr\": \"addr\",      (string) Masternode BITG address\n"
+            "    \"version\": v,        (numeric) Masternode protocol version\n"
+            "    \"lastseen\": ttt,     (numeric) The time in seconds since epoch (Jan 1 1970 GMT) of the last seen\n"
+            "    \"activetime\": ttt,   (numeric) The time in seconds since epoch (Jan 1 1970 GMT) masternode has been active\n"
+            "    \"lastpaid\": ttt,     (numeric) The time in seconds since epoch (Jan 1 1970 GMT) masternode was last paid\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("listmasternodes", "") + HelpExampleRpc("listmasternodes", ""));
+
+    UniValue ret(UniValue::VARR);
+    if (!ListMasternodeEntries(strFilter, [&ret](const UniValue& obj) { ret.push_back(obj); }))
+        return 0;
+
     return ret;
 }
 
+void listmasternodes_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    if (params.size() > 1) {
+        writer.Value(listmasternodes(params, false));
+        return;
+    }
+    std::string strFilter = "";
+    if (params.size() == 1) strFilter = params[0].get_str();
+
+    {
+        LOCK(cs_main);
+        if (!chainActive.Tip()) {
+            writer.Value(0);
+            return;
+        }
+    }
+
+    // The entries are written as they are made, rather than collected first
+    writer.BeginArray();
+    ListMasternodeEntries(strFilter, [&writer](const UniValue& obj) { writer.Value(obj); });
+    writer.EndArray();
+}
+
+void masternode_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    // Only "masternode list" is large
+    if (params.size() < 1 || params[0].get_str() != "list") {
+        writer.Value(masternode(params, false));
+        return;
+    }
+
+    UniValue newParams(UniValue::VARR);
+    // forward params but skip command
+    for (unsigned int i = 1; i < params.size(); i++) {
+        newParams.push_back(params[i]);
+    }
+    listmasternodes_stream(newParams, writer);
+}
+
 UniValue masternodeconnect(const UniValue& params, bool fHelp)
 {
     if (fHelp || (params.size() != 1))
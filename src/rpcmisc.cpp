@@ -21,6 +21,8 @@
 #include "walletdb.h"
 #endif
 
+#include <algorithm>
+#include <set>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -517,6 +519,302 @@ UniValue verifymessage(const UniValue& params, bool fHelp)
     return (pubkey.GetID() == keyID);
 }
 
+static std::string AddressIndexToString(const uint160& hashBytes, int type)
+{
+    return CBitcoinAddress(GetAddressIndexDestination(hashBytes, type)).ToString();
+}
+
+/** Parse a single address string or an {"addresses": [...]} object */
+static void ParseAddressIndexParams(const UniValue& param, std::vector<std::pair<uint160, int> >& addresses)
+{
+    std::vector<std::string> vAddresses;
+    if (param.isStr()) {
+        vAddresses.push_back(param.get_str());
+    } else if (param.isObject()) {
+        UniValue addressValues = find_value(param.get_obj(), "addresses");
+        if (!addressValues.isArray())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Addresses is expected to be an array");
+        for (unsigned int i = 0; i < addressValues.size(); i++)
+            vAddresses.push_back(addressValues[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    BOOST_FOREACH (const std::string& strAddress, vAddresses) {
+        CBitcoinAddress address(strAddress);
+        uint160 hashBytes;
+        int type = ADDRESS_TYPE_UNKNOWN;
+        if (!address.IsValid() || !GetAddressIndexKey(address.Get(), hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        addresses.push_back(std::make_pair(hashBytes, type));
+    }
+}
+
+static const std::string strAddressIndexArgHelp =
+    "{\n"
+    "  \"addresses\"\n"
+    "    [\n"
+    "      \"address\"  (string) The base58check encoded address\n"
+    "      ,...\n"
+    "    ]\n"
+    "}\n";
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance for an address(es) (requires -addressindex to be enabled).\n"
+
+            "\nArguments:\n" +
+            strAddressIndexArgHelp +
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,   (numeric) The current balance in satoshis\n"
+            "  \"received\": n,  (numeric) The total number of satoshis received (including change)\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}"));
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator ait = addressIndex.begin(); ait != addressIndex.end(); ait++) {
+            if (ait->second > 0)
+                received += ait->second;
+            balance += ait->second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", balance));
+    result.push_back(Pair("received", received));
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the confirmed txids for an address(es) (requires -addressindex to be enabled).\n"
+
+            "\nArguments:\n" +
+            strAddressIndexArgHelp +
+            "  \"start\" (number, optional) The start block height\n"
+            "  \"end\"   (number, optional) The end block height\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}"));
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    int start = 0;
+    int end = 0;
+    if (params[0].isObject()) {
+        UniValue startValue = find_value(params[0].get_obj(), "start");
+        UniValue endValue = find_value(params[0].get_obj(), "end");
+        if (startValue.isNum() && endValue.isNum()) {
+            start = startValue.get_int();
+            end = endValue.get_int();
+            if (start <= 0 || end < start)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be greater than zero, with start <= end");
+        }
+    }
+
+    // Order by height and position in the block, each txid once
+    std::set<std::pair<std::pair<int, unsigned int>, uint256> > txids;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, start, end))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator ait = addressIndex.begin(); ait != addressIndex.end(); ait++)
+            txids.insert(std::make_pair(std::make_pair(ait->first.blockHeight, ait->first.txindex), ait->first.txhash));
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::set<std::pair<std::pair<int, unsigned int>, uint256> >::const_iterator it = txids.begin(); it != txids.end(); it++)
+        result.push_back(it->second.GetHex());
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos {\"addresses\": [\"address\",...]}\n"
+            "\nReturns all confirmed unspent outputs for an address(es) (requires -addressindex to be enabled).\n"
+
+            "\nArguments:\n" +
+            strAddressIndexArgHelp +
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address base58check encoded\n"
+            "    \"txid\": \"hash\",        (string) The output txid\n"
+            "    \"outputIndex\": n,      (number) The output index\n"
+            "    \"script\": \"hex\",       (string) The script hex encoded\n"
+            "    \"satoshis\": n,         (number) The number of satoshis of the output\n"
+            "    \"height\": n            (number) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}"));
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!GetAddressUnspent(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    std::stable_sort(unspentOutputs.begin(), unspentOutputs.end(),
+        [](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+            return a.second.blockHeight < b.second.blockHeight;
+        });
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", AddressIndexToString(it->first.hashBytes, it->first.type)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("satoshis", it->second.satoshis));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddressmempool(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressmempool {\"addresses\": [\"address\",...]}\n"
+            "\nReturns all mempool deltas for an address(es) (requires -addressindex to be enabled).\n"
+
+            "\nArguments:\n" +
+            strAddressIndexArgHelp +
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The base58check encoded address\n"
+            "    \"txid\": \"hash\",        (string) The related txid\n"
+            "    \"index\": n,            (number) The related input or output index\n"
+            "    \"satoshis\": n,         (number) The difference of satoshis\n"
+            "    \"timestamp\": n,        (number) The time the transaction entered the mempool (seconds)\n"
+            "    \"prevtxid\": \"hash\",    (string) The previous txid (if spending)\n"
+            "    \"prevout\": n           (number) The previous transaction output index (if spending)\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressmempool", "'{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}'") +
+            HelpExampleRpc("getaddressmempool", "{\"addresses\": [\"GfhbLQkC7JYXZMwSWPt4zQGxJxd8R6ZQKs\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > indexes;
+    mempool.getAddressIndex(addresses, indexes);
+
+    std::stable_sort(indexes.begin(), indexes.end(),
+        [](const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& a, const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& b) {
+            return a.second.time < b.second.time;
+        });
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::const_iterator it = indexes.begin(); it != indexes.end(); it++) {
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("address", AddressIndexToString(it->first.addressBytes, it->first.type)));
+        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)it->first.index));
+        delta.push_back(Pair("satoshis", it->second.amount));
+        delta.push_back(Pair("timestamp", it->second.time));
+        if (it->second.amount < 0) {
+            delta.push_back(Pair("prevtxid", it->second.prevhash.GetHex()));
+            delta.push_back(Pair("prevout", (int)it->second.prevout));
+        }
+        result.push_back(delta);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the txid and index where an output is spent (requires -spentindex to be enabled).\n"
+
+            "\nArguments:\n"
+            "{\n"
+            "  \"txid\" (string) The hex string of the txid\n"
+            "  \"index\" (number) The output index\n"
+            "}\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\"  (string) The transaction id\n"
+            "  \"index\"  (number) The spending input index\n"
+            "  \"height\"  (number) The height of the spending block, -1 if it is in the mempool\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    UniValue txidValue = find_value(params[0].get_obj(), "txid");
+    UniValue indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    uint256 txid = ParseHashV(txidValue, "txid");
+    int outputIndex = indexValue.get_int();
+    if (outputIndex < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+
+    CSpentIndexKey key(txid, outputIndex);
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+    return obj;
+}
+
 UniValue setmocktime(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
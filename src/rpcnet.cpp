@@ -75,6 +75,23 @@ static void CopyNodeStats(std::vector<CNodeStats>& vstats)
     }
 }
 
+static UniValue MessageStatsToJSON(const mapMsgCmdStats& mapStats)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& entry : mapStats) {
+        const CNetMessageStats& stats = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("bytessent", stats.nSendBytes));
+        obj.push_back(Pair("bytesrecv", stats.nRecvBytes));
+        obj.push_back(Pair("msgssent", stats.nSendMsgs));
+        obj.push_back(Pair("msgsrecv", stats.nRecvMsgs));
+        obj.push_back(Pair("processtime", ((double)stats.nProcessTime) / 1e6));
+        obj.push_back(Pair("processtimemax", ((double)stats.nProcessTimeMax) / 1e6));
+        ret.push_back(Pair(entry.first, obj));
+    }
+    return ret;
+}
+
 UniValue getpeerinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -107,7 +124,12 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
+            "    \"msgstats\": {              (json object) Traffic and handling time per message command, see getnetmsgstats\n"
+            "       \"command\": { ... },\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -158,6 +180,7 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             obj.push_back(Pair("inflight", heights));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("msgstats", MessageStatsToJSON(stats.mapMsgStats)));
 
         ret.push_back(obj);
     }
@@ -366,6 +389,35 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getnetmsgstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns network traffic and message handling time per P2P message command,\n"
+            "summed over all peers since startup. Unknown commands are grouped under \"" NET_MESSAGE_COMMAND_OTHER "\".\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {             (json object) Statistics for one message command, e.g. \"inv\" or \"mnb\"\n"
+            "    \"bytessent\": n,        (numeric) Total bytes sent, including message headers\n"
+            "    \"bytesrecv\": n,        (numeric) Total bytes received, including message headers\n"
+            "    \"msgssent\": n,         (numeric) Number of messages sent\n"
+            "    \"msgsrecv\": n,         (numeric) Number of messages received\n"
+            "    \"processtime\": n,      (numeric) Total time in seconds spent handling received messages\n"
+            "    \"processtimemax\": n    (numeric) Longest time in seconds spent handling a single message\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getnetmsgstats", "") + HelpExampleRpc("getnetmsgstats", ""));
+
+    mapMsgCmdStats mapStats;
+    CNode::GetTotalMessageStats(mapStats);
+    return MessageStatsToJSON(mapStats);
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -65,6 +65,113 @@ UniValue JSONRPCError(int code, const string& message)
     return error;
 }
 
+JSONStreamWriter::JSONStreamWriter(const SinkFn& sinkIn, size_t nChunkSizeIn) : sink(sinkIn),
+                                                                                 nChunkSize(nChunkSizeIn),
+                                                                                 fAfterKey(false),
+                                                                                 fFlushed(false)
+{
+}
+
+void JSONStreamWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vFirst.empty()) {
+        if (!vFirst.back())
+            strBuffer += ',';
+        vFirst.back() = false;
+    }
+}
+
+void JSONStreamWriter::Write(const string& str)
+{
+    strBuffer += str;
+    if (strBuffer.size() >= nChunkSize)
+        Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    vFirst.push_back(true);
+    Write("{");
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    Write("}");
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    vFirst.push_back(true);
+    Write("[");
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    Write("]");
+}
+
+void JSONStreamWriter::Key(const string& strKey)
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    BeginValue();
+    Write(UniValue(strKey).write() + ":");
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& val)
+{
+    if (val.isObject()) {
+        BeginObject();
+        const vector<string>& keys = val.getKeys();
+        const vector<UniValue>& values = val.getValues();
+        for (unsigned int i = 0; i < keys.size(); i++) {
+            Key(keys[i]);
+            Value(values[i]);
+        }
+        EndObject();
+    } else if (val.isArray()) {
+        BeginArray();
+        const vector<UniValue>& values = val.getValues();
+        for (unsigned int i = 0; i < values.size(); i++)
+            Value(values[i]);
+        EndArray();
+    } else {
+        BeginValue();
+        Write(val.write());
+    }
+}
+
+void JSONStreamWriter::Raw(const string& str)
+{
+    Write(str);
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    fFlushed = true;
+    sink(strBuffer);
+    strBuffer.clear();
+}
+
+string JSONStreamWriter::ReleaseBuffer()
+{
+    string str;
+    str.swap(strBuffer);
+    return str;
+}
+
 /** Username used when cookie authentication is in use (arbitrary, only for
  * recognizability in debugging/logging purposes)
  */
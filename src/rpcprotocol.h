@@ -8,10 +8,12 @@
 #ifndef BITCOIN_RPCPROTOCOL_H
 #define BITCOIN_RPCPROTOCOL_H
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include <boost/filesystem.hpp>
 
 #include <univalue.h>
@@ -81,6 +83,52 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
+//! Size at which JSONStreamWriter hands buffered output to its sink
+static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Incremental JSON serializer for large RPC results.
+ * Output is compact (as UniValue::write() without indentation) and is passed
+ * to the sink in pieces of about nChunkSize bytes, so a large reply never has
+ * to exist as a complete UniValue tree or a single string.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> SinkFn;
+
+    JSONStreamWriter(const SinkFn& sinkIn, size_t nChunkSizeIn = JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! Write the key of the next object member, must be followed by one value
+    void Key(const std::string& strKey);
+    //! Write a value; arrays and objects are serialized member by member
+    void Value(const UniValue& val);
+    //! Append text outside of the JSON structure (e.g. a trailing newline)
+    void Raw(const std::string& str);
+
+    //! Pass all buffered output to the sink
+    void Flush();
+    //! Whether output has been passed to the sink yet
+    bool Flushed() const { return fFlushed; }
+    //! Take the buffered output instead of passing it to the sink
+    std::string ReleaseBuffer();
+
+private:
+    SinkFn sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+    std::vector<bool> vFirst; //! one entry per open array/object: no member written yet
+    bool fAfterKey;
+    bool fFlushed;
+
+    void BeginValue();
+    void Write(const std::string& str);
+};
+
 /** Get name of RPC authentication cookie file */
 boost::filesystem::path GetAuthCookieFile();
 /** Generate a new RPC authentication cookie and write it to disk */
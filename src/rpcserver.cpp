@@ -29,6 +29,9 @@
 
 #include <univalue.h>
 
+#include <atomic>
+#include <set>
+
 using namespace RPCServer;
 using namespace std;
 
@@ -36,6 +39,8 @@ static bool fRPCRunning = false;
 static bool fRPCInWarmup = true;
 static std::string rpcWarmupStatus("RPC server started");
 static CCriticalSection cs_rpcWarmup;
+//! Threads running batch elements besides the threads serving the requests, shared by all batches
+static CSemaphore* semBatchWorkers = nullptr;
 
 /* Timer-creating functions */
 static RPCTimerInterface* timerInterface = nullptr;
@@ -292,18 +297,26 @@ static const CRPCCommand vRPCCommands[] =
         {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false},
         {"network", "getconnectioncount", &getconnectioncount, true, false, false},
         {"network", "getnettotals", &getnettotals, true, true, false},
+        {"network", "getnetmsgstats", &getnetmsgstats, true, true, false},
         {"network", "getpeerinfo", &getpeerinfo, true, false, false},
         {"network", "ping", &ping, true, false, false},
         {"network", "setban", &setban, true, false, false},
         {"network", "listbanned", &listbanned, true, false, false},
         {"network", "clearbanned", &clearbanned, true, false, false},
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+        {"addressindex", "getaddressmempool", &getaddressmempool, true, false, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+
         /* Block chain and UTXO */
         {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
         {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
         {"blockchain", "getblockcount", &getblockcount, true, false, false},
         {"blockchain", "getblock", &getblock, true, false, false},
         {"blockchain", "getblockhash", &getblockhash, true, false, false},
+        {"blockchain", "getblockhashes", &getblockhashes, true, false, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
@@ -311,6 +324,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
         {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
         {"blockchain", "gettxout", &gettxout, true, false, false},
+        {"blockchain", "getspentinfo", &getspentinfo, true, false, false},
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -388,6 +402,7 @@ static const CRPCCommand vRPCCommands[] =
 
 #ifdef ENABLE_WALLET
         /* Wallet */
+        {"wallet", "abortrescan", &abortrescan, true, false, true},
         {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
         {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
         {"wallet", "backupwallet", &backupwallet, true, false, true},
@@ -438,6 +453,58 @@ static const CRPCCommand vRPCCommands[] =
 #endif // ENABLE_WALLET
 };
 
+/**
+ * Streaming implementations of methods whose results can grow very large.
+ */
+static const struct {
+    const char* name;
+    rpcstreamfn_type actor;
+} vRPCStreamCommands[] = {
+    {"getblock", &getblock_stream},
+    {"getrawmempool", &getrawmempool_stream},
+    {"getbudgetinfo", &getbudgetinfo_stream},
+    {"listmasternodes", &listmasternodes_stream},
+    {"masternode", &masternode_stream},
+#ifdef ENABLE_WALLET
+    {"listtransactions", &listtransactions_stream},
+    {"listunspent", &listunspent_stream},
+#endif
+};
+
+/**
+ * Methods that only read state and do their own locking. Consecutive batch
+ * elements calling these are executed concurrently; any other method is
+ * executed on its own, in order.
+ */
+static const char* const ppszParallelBatchCommands[] = {
+    "getaddressbalance",
+    "getaddressmempool",
+    "getaddresstxids",
+    "getaddressutxos",
+    "getbestblockhash",
+    "getblock",
+    "getblockchaininfo",
+    "getblockcount",
+    "getblockhash",
+    "getblockhashes",
+    "getblockheader",
+    "getconnectioncount",
+    "getdifficulty",
+    "getmempoolinfo",
+    "getnetmsgstats",
+    "getnettotals",
+    "getnetworkinfo",
+    "getpeerinfo",
+    "getrawmempool",
+    "getrawtransaction",
+    "getspentinfo",
+    "gettxout",
+    "decoderawtransaction",
+    "decodescript",
+    "validateaddress",
+    "verifymessage",
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -447,6 +514,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamCommands[vRPCStreamCommands[vcidx].name] = vRPCStreamCommands[vcidx].actor;
 }
 
 const CRPCCommand *CRPCTable::operator[](const std::string &name) const
@@ -460,6 +529,8 @@ const CRPCCommand *CRPCTable::operator[](const std::string &name) const
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
+    if (!semBatchWorkers)
+        semBatchWorkers = new CSemaphore(std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS) - 1, 0));
     fRPCRunning = true;
     g_rpcSignals.Started();
     return true;
@@ -556,13 +627,65 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+static bool IsParallelBatchRequest(const UniValue& req)
+{
+    static const std::set<std::string> setParallel(ppszParallelBatchCommands,
+        ppszParallelBatchCommands + (sizeof(ppszParallelBatchCommands) / sizeof(ppszParallelBatchCommands[0])));
+
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    return method.isStr() && setParallel.count(method.get_str());
+}
+
+static void JSONRPCExecRange(const UniValue& vReq, std::vector<UniValue>& vResults, std::atomic<unsigned int>& nNext, unsigned int nEnd)
+{
+    unsigned int reqIdx;
+    while ((reqIdx = nNext++) < nEnd)
+        vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    std::vector<UniValue> vResults(vReq.size());
+    int nThreads = std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        unsigned int nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsParallelBatchRequest(vReq[nEnd]))
+            nEnd++;
+
+        if (nThreads <= 1 || nEnd - reqIdx < 2) {
+            vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+            continue;
+        }
+
+        // Run of read-only requests: the calling thread helps the workers, and
+        // does it all alone when other batches use up the worker threads
+        std::atomic<unsigned int> nNext(reqIdx);
+        boost::thread_group workers;
+        int nWorkers = 0;
+        while (semBatchWorkers && nWorkers + 1 < std::min(nThreads, (int)(nEnd - reqIdx)) && semBatchWorkers->try_wait()) {
+            workers.create_thread(boost::bind(&JSONRPCExecRange, boost::cref(vReq), boost::ref(vResults), boost::ref(nNext), nEnd));
+            nWorkers++;
+        }
+        JSONRPCExecRange(vReq, vResults, nNext, nEnd);
+        workers.join_all();
+        for (int i = 0; i < nWorkers; i++)
+            semBatchWorkers->post();
+        reqIdx = nEnd;
+    }
 
-    return ret.write() + "\n";
+    std::string strReply = "[";
+    for (unsigned int i = 0; i < vResults.size(); i++) {
+        if (i > 0)
+            strReply += ",";
+        strReply += vResults[i].write();
+        vResults[i].setNull();
+    }
+    return strReply + "]\n";
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
@@ -584,6 +707,29 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+void CRPCTable::executeStream(const std::string &strMethod, const UniValue &params, JSONStreamWriter &writer) const
+{
+    // Find method
+    const CRPCCommand* pcmd = tableRPC[strMethod];
+    if (!pcmd)
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    try {
+        // Execute
+        std::map<std::string, rpcstreamfn_type>::const_iterator it = mapStreamCommands.find(strMethod);
+        if (it != mapStreamCommands.end())
+            it->second(params, writer);
+        else
+            writer.Value(pcmd->actor(params, false));
+    } catch (std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
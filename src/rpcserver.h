@@ -23,6 +23,11 @@
 
 class CRPCCommand;
 
+//! Default number of threads executing the read-only elements of a JSON-RPC batch
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+//! Entries a streaming method looks up per lock, before writing them out without the lock
+static const unsigned int RPC_STREAM_ENTRIES_PER_LOCK = 1000;
+
 namespace RPCServer
 {
     void OnStarted(boost::function<void ()> slot);
@@ -116,6 +121,12 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+/** Streaming implementation of an RPC method: writes the result to writer
+ * instead of returning it. Errors must be thrown before any output is
+ * written; once output reached the client the connection is aborted.
+ */
+typedef void(*rpcstreamfn_type)(const UniValue& params, JSONStreamWriter& writer);
+
 class CRPCCommand
 {
 public:
@@ -134,6 +145,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamCommands;
 
 public:
     CRPCTable();
@@ -149,6 +161,14 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, writing its result to writer.
+     * Uses the streaming implementation of the method if there is one,
+     * otherwise the result of execute() is serialized incrementally.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    void executeStream(const std::string &method, const UniValue &params, JSONStreamWriter &writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -186,6 +206,7 @@ extern UniValue addnode(const UniValue& params, bool fHelp);
 extern UniValue disconnectnode(const UniValue& params, bool fHelp);
 extern UniValue getaddednodeinfo(const UniValue& params, bool fHelp);
 extern UniValue getnettotals(const UniValue& params, bool fHelp);
+extern UniValue getnetmsgstats(const UniValue& params, bool fHelp);
 extern UniValue setban(const UniValue& params, bool fHelp);
 extern UniValue listbanned(const UniValue& params, bool fHelp);
 extern UniValue clearbanned(const UniValue& params, bool fHelp);
@@ -229,10 +250,12 @@ extern UniValue addmultisigaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaccount(const UniValue& params, bool fHelp);
 extern UniValue listtransactions(const UniValue& params, bool fHelp);
+extern void listtransactions_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue listaddressgroupings(const UniValue& params, bool fHelp);
 extern UniValue listaccounts(const UniValue& params, bool fHelp);
 extern UniValue listsinceblock(const UniValue& params, bool fHelp);
 extern UniValue gettransaction(const UniValue& params, bool fHelp);
+extern UniValue abortrescan(const UniValue& params, bool fHelp);
 extern UniValue backupwallet(const UniValue& params, bool fHelp);
 extern UniValue keypoolrefill(const UniValue& params, bool fHelp);
 extern UniValue walletpassphrase(const UniValue& params, bool fHelp);
@@ -250,6 +273,7 @@ extern UniValue autocombinerewards(const UniValue& params, bool fHelp);
 
 extern UniValue getrawtransaction(const UniValue& params, bool fHelp); // in rcprawtransaction.cpp
 extern UniValue listunspent(const UniValue& params, bool fHelp);
+extern void listunspent_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue lockunspent(const UniValue& params, bool fHelp);
 extern UniValue listlockunspent(const UniValue& params, bool fHelp);
 extern UniValue createrawtransaction(const UniValue& params, bool fHelp);
@@ -264,8 +288,11 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern void getrawmempool_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
+extern UniValue getblockhashes(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern void getblock_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
@@ -276,7 +303,9 @@ extern UniValue invalidateblock(const UniValue& params, bool fHelp);
 extern UniValue reconsiderblock(const UniValue& params, bool fHelp);
 
 extern UniValue masternode(const UniValue& params, bool fHelp); // in rpcmasternode.cpp
+extern void masternode_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue listmasternodes(const UniValue& params, bool fHelp);
+extern void listmasternodes_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue getmasternodecount(const UniValue& params, bool fHelp);
 extern UniValue masternodeconnect(const UniValue& params, bool fHelp);
 extern UniValue masternodecurrent(const UniValue& params, bool fHelp);
@@ -298,6 +327,7 @@ extern UniValue getbudgetvotes(const UniValue& params, bool fHelp);
 extern UniValue getnextsuperblock(const UniValue& params, bool fHelp);
 extern UniValue getbudgetprojection(const UniValue& params, bool fHelp);
 extern UniValue getbudgetinfo(const UniValue& params, bool fHelp);
+extern void getbudgetinfo_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue mnbudgetrawvote(const UniValue& params, bool fHelp);
 extern UniValue mnfinalbudget(const UniValue& params, bool fHelp);
 extern UniValue checkbudgets(const UniValue& params, bool fHelp);
@@ -310,6 +340,11 @@ extern UniValue getcommunityproposalvotes(const UniValue& params, bool fHelp);
 extern UniValue mncommunityvote(const UniValue& params, bool fHelp);
 
 extern UniValue getinfo(const UniValue& params, bool fHelp); // in rpcmisc.cpp
+extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue getaddresstxids(const UniValue& params, bool fHelp);
+extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
+extern UniValue getaddressmempool(const UniValue& params, bool fHelp);
+extern UniValue getspentinfo(const UniValue& params, bool fHelp);
 extern UniValue mnsync(const UniValue& params, bool fHelp);
 extern UniValue spork(const UniValue& params, bool fHelp);
 extern UniValue validateaddress(const UniValue& params, bool fHelp);
@@ -13,8 +13,12 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
+#include <assert.h>
+#include <string.h>
+
 using namespace std;
 
 typedef vector<unsigned char> valtype;
@@ -58,7 +62,8 @@ bool CastToBool(const valtype& vch)
  */
 #define stacktop(i)  (stack.at(stack.size()+(i)))
 #define altstacktop(i)  (altstack.at(altstack.size()+(i)))
-static inline void popstack(vector<valtype>& stack)
+template <typename Stack>
+static inline void popstack(Stack& stack)
 {
     if (stack.empty())
         throw runtime_error("popstack() : stack empty");
@@ -237,7 +242,11 @@ bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
     return true;
 }
 
-bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+namespace {
+
+/** EvalScript on either a std::vector stack or a CScriptStack; altstack and vfExec are only passed in for their buffers */
+template <typename Stack>
+bool EvalScriptImpl(Stack& stack, Stack& altstack, vector<bool>& vfExec, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -252,8 +261,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     CScript::const_iterator pbegincodehash = script.begin();
     opcodetype opcode;
     valtype vchPushValue;
-    vector<bool> vfExec;
-    vector<valtype> altstack;
+    vfExec.clear();
+    altstack.clear();
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > 10000)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -439,10 +448,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x1 x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-2);
-                    valtype vch2 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(stacktop(-2));
+                    stack.push_back(stacktop(-2));
                 }
                 break;
 
@@ -451,12 +458,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-3);
-                    valtype vch2 = stacktop(-2);
-                    valtype vch3 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
-                    stack.push_back(vch3);
+                    stack.push_back(stacktop(-3));
+                    stack.push_back(stacktop(-3));
+                    stack.push_back(stacktop(-3));
                 }
                 break;
 
@@ -465,10 +469,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-4);
-                    valtype vch2 = stacktop(-3);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(stacktop(-4));
+                    stack.push_back(stacktop(-4));
                 }
                 break;
 
@@ -477,11 +479,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
-                    stack.erase(stack.end()-6, stack.end()-4);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    std::rotate(stack.end()-6, stack.end()-4, stack.end());
                 }
                 break;
 
@@ -500,9 +498,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    if (CastToBool(vch))
-                        stack.push_back(vch);
+                    if (CastToBool(stacktop(-1)))
+                        stack.push_back(stacktop(-1));
                 }
                 break;
 
@@ -528,8 +525,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x -- x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.push_back(vch);
+                    stack.push_back(stacktop(-1));
                 }
                 break;
 
@@ -547,8 +543,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-2);
-                    stack.push_back(vch);
+                    stack.push_back(stacktop(-2));
                 }
                 break;
 
@@ -563,10 +558,10 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     popstack(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-n-1);
                     if (opcode == OP_ROLL)
-                        stack.erase(stack.end()-n-1);
-                    stack.push_back(vch);
+                        std::rotate(stack.end()-n-1, stack.end()-n, stack.end());
+                    else
+                        stack.push_back(stacktop(-n-1));
                 }
                 break;
 
@@ -596,8 +591,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.insert(stack.end()-2, vch);
+                    stack.insert(stack.end()-2, stacktop(-1));
                 }
                 break;
 
@@ -761,19 +755,20 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    unsigned char vchHash[32];
+                    size_t nHashSize = (opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32;
                     if (opcode == OP_RIPEMD160)
-                        CRIPEMD160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CRIPEMD160().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA1)
-                        CSHA1().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA1().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA256)
-                        CSHA256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA256().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH160)
-                        CHash160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CHash160().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH256)
-                        CHash256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
-                    popstack(stack);
-                    stack.push_back(vchHash);
+                        CHash256().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
+                    // Replace the input by its hash in place, reusing its buffer
+                    vch.assign(vchHash, vchHash + nHashSize);
                 }
                 break;
 
@@ -936,8 +931,40 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     return set_success(serror);
 }
 
+} // anon namespace
+
+bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    vector<valtype> altstack;
+    vector<bool> vfExec;
+    return EvalScriptImpl(stack, altstack, vfExec, script, flags, checker, serror);
+}
+
 namespace {
 
+/** Serialize a scriptCode for a signature hash, skipping OP_CODESEPARATORs */
+template<typename S>
+void SerializeScriptCode(S &s, const CScript &scriptCode) {
+    CScript::const_iterator it = scriptCode.begin();
+    CScript::const_iterator itBegin = it;
+    opcodetype opcode;
+    unsigned int nCodeSeparators = 0;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR)
+            nCodeSeparators++;
+    }
+    ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
+    it = itBegin;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR) {
+            s.write((char*)&itBegin[0], it-itBegin-1);
+            itBegin = it;
+        }
+    }
+    if (itBegin != scriptCode.end())
+        s.write((char*)&itBegin[0], it-itBegin);
+}
+
 /**
  * Wrapper that serializes like CTransaction, but with the modifications
  *  required for the signature hash done in-place
@@ -958,29 +985,6 @@ public:
         fHashSingle((nHashTypeIn & 0x1f) == SIGHASH_SINGLE),
         fHashNone((nHashTypeIn & 0x1f) == SIGHASH_NONE) {}
 
-    /** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
-    template<typename S>
-    void SerializeScriptCode(S &s, int nType, int nVersion) const {
-        CScript::const_iterator it = scriptCode.begin();
-        CScript::const_iterator itBegin = it;
-        opcodetype opcode;
-        unsigned int nCodeSeparators = 0;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR)
-                nCodeSeparators++;
-        }
-        ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
-        it = itBegin;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR) {
-                s.write((char*)&itBegin[0], it-itBegin-1);
-                itBegin = it;
-            }
-        }
-        if (itBegin != scriptCode.end())
-            s.write((char*)&itBegin[0], it-itBegin);
-    }
-
     /** Serialize an input of txTo */
     template<typename S>
     void SerializeInput(S &s, unsigned int nInput, int nType, int nVersion) const {
@@ -994,7 +998,7 @@ public:
             // Blank out other inputs' signatures
             ::Serialize(s, CScript(), nType, nVersion);
         else
-            SerializeScriptCode(s, nType, nVersion);
+            SerializeScriptCode(s, scriptCode);
         // Serialize the nSequence
         if (nInput != nIn && (fHashSingle || fHashNone))
             // let the others update at will
@@ -1033,10 +1037,159 @@ public:
     }
 };
 
+/** Stream that hashes like CHashWriter, but can go on from a precomputed SHA256 state */
+class CSignatureHashWriter {
+private:
+    CSHA256 sha;
+
+public:
+    int nType;
+    int nVersion;
+
+    explicit CSignatureHashWriter(const CSHA256& shaIn = CSHA256()) : sha(shaIn), nType(SER_GETHASH), nVersion(0) {}
+
+    CSignatureHashWriter& write(const char *pch, size_t size) {
+        sha.Write((const unsigned char*)pch, size);
+        return (*this);
+    }
+
+    template<typename T>
+    CSignatureHashWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    const CSHA256& GetState() const { return sha; }
+
+    // invalidates the object
+    uint256 GetHash() {
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        sha.Finalize(buf);
+        uint256 result;
+        CSHA256().Write(buf, sizeof(buf)).Finalize((unsigned char*)&result);
+        return result;
+    }
+};
+
+/** Size of an input with its script blanked out: prevout, empty script, nSequence */
+const size_t BLANKED_INPUT_SIZE = 36 + 1 + 4;
+const size_t BLANKED_INPUT_SEQUENCE = 36 + 1;
+//! nSequence of the other inputs in SIGHASH_NONE and SIGHASH_SINGLE hashes
+const char ZERO_SEQUENCE[4] = {0, 0, 0, 0};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& tx)
 {
+    Init(tx);
+}
+
+PrecomputedTransactionData::PrecomputedTransactionData(const CMutableTransaction& tx)
+{
+    Init(tx);
+}
+
+template <typename T>
+void PrecomputedTransactionData::Init(const T& tx)
+{
+    nVersion = tx.nVersion;
+    nLockTime = tx.nLockTime;
+
+    CDataStream ssInputs(SER_GETHASH, 0);
+    ssInputs.reserve(tx.vin.size() * BLANKED_INPUT_SIZE);
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+        ssInputs << tx.vin[i].prevout << CScript() << tx.vin[i].nSequence;
+    vBlankedInputs.assign(ssInputs.begin(), ssInputs.end());
+
+    CDataStream ssOutputs(SER_GETHASH, 0);
+    vOutputPos.reserve(tx.vout.size() + 1);
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        vOutputPos.push_back(ssOutputs.size());
+        ssOutputs << tx.vout[i];
+    }
+    vOutputPos.push_back(ssOutputs.size());
+    vOutputs.assign(ssOutputs.begin(), ssOutputs.end());
+
+    CSignatureHashWriter ss;
+    ss << nVersion;
+    ::WriteCompactSize(ss, tx.vin.size());
+    vPrefix.reserve(tx.vin.size());
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        vPrefix.push_back(ss.GetState());
+        ss.write((const char*)&vBlankedInputs[i * BLANKED_INPUT_SIZE], BLANKED_INPUT_SIZE);
+    }
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const PrecomputedTransactionData& txdata, unsigned int nIn, int nHashType)
+{
+    const bool fAnyoneCanPay = !!(nHashType & SIGHASH_ANYONECANPAY);
+    const bool fHashSingle = (nHashType & 0x1f) == SIGHASH_SINGLE;
+    const bool fHashNone = (nHashType & 0x1f) == SIGHASH_NONE;
+    const unsigned int nInputs = txdata.GetInputCount();
+    const unsigned int nOutputs = txdata.GetOutputCount();
+
+    if (nIn >= nInputs) {
+        //  nIn out of range
+        return 1;
+    }
+    if (fHashSingle && nIn >= nOutputs) {
+        //  nOut out of range
+        return 1;
+    }
+
+    // The same serialization as CTransactionSignatureSerializer, from the precomputed parts
+    const char* pInputs = (const char*)&txdata.vBlankedInputs[0];
+    const char* pInput = pInputs + nIn * BLANKED_INPUT_SIZE;
+    CSignatureHashWriter ss;
+    if (!fAnyoneCanPay && !fHashSingle && !fHashNone) {
+        ss = CSignatureHashWriter(txdata.vPrefix[nIn]);
+    } else {
+        ss << txdata.nVersion;
+        ::WriteCompactSize(ss, fAnyoneCanPay ? 1 : nInputs);
+    }
+    if (!fAnyoneCanPay && (fHashSingle || fHashNone)) {
+        for (unsigned int i = 0; i < nIn; i++) {
+            ss.write(pInputs + i * BLANKED_INPUT_SIZE, BLANKED_INPUT_SEQUENCE);
+            ss.write(ZERO_SEQUENCE, sizeof(ZERO_SEQUENCE));
+        }
+    }
+    ss.write(pInput, 36);
+    SerializeScriptCode(ss, scriptCode);
+    ss.write(pInput + BLANKED_INPUT_SEQUENCE, 4);
+    if (!fAnyoneCanPay) {
+        if (fHashSingle || fHashNone) {
+            for (unsigned int i = nIn + 1; i < nInputs; i++) {
+                ss.write(pInputs + i * BLANKED_INPUT_SIZE, BLANKED_INPUT_SEQUENCE);
+                ss.write(ZERO_SEQUENCE, sizeof(ZERO_SEQUENCE));
+            }
+        } else if (nIn + 1 < nInputs) {
+            ss.write(pInput + BLANKED_INPUT_SIZE, (nInputs - nIn - 1) * BLANKED_INPUT_SIZE);
+        }
+    }
+
+    if (fHashNone) {
+        ::WriteCompactSize(ss, 0);
+    } else if (fHashSingle) {
+        ::WriteCompactSize(ss, nIn + 1);
+        for (unsigned int i = 0; i < nIn; i++)
+            ss << CTxOut();
+        ss.write((const char*)&txdata.vOutputs[txdata.vOutputPos[nIn]], txdata.vOutputPos[nIn + 1] - txdata.vOutputPos[nIn]);
+    } else {
+        ::WriteCompactSize(ss, nOutputs);
+        if (!txdata.vOutputs.empty())
+            ss.write((const char*)&txdata.vOutputs[0], txdata.vOutputs.size());
+    }
+    ss << txdata.nLockTime << nHashType;
+    return ss.GetHash();
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata)
+{
+    if (txdata) {
+        assert(txdata->GetInputCount() == txTo.vin.size() && txdata->GetOutputCount() == txTo.vout.size());
+        return SignatureHash(scriptCode, *txdata, nIn, nHashType);
+    }
+
     if (nIn >= txTo.vin.size()) {
         //  nIn out of range
         return 1;
@@ -1077,7 +1230,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = txdata ? SignatureHash(scriptCode, *txdata, nIn, nHashType) : SignatureHash(scriptCode, *txTo, nIn, nHashType);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1085,7 +1238,236 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     return true;
 }
 
+CScriptStack& CScriptStack::operator=(const CScriptStack& other)
+{
+    if (this != &other) {
+        clear();
+        for (const_iterator it = other.begin(); it != other.end(); ++it)
+            push_back(*it);
+    }
+    return *this;
+}
+
+valtype& CScriptStack::at(size_t nPos)
+{
+    if (nPos >= nSize)
+        throw out_of_range("CScriptStack::at() : out of range");
+    return vSlots[nPos];
+}
+
+void CScriptStack::push_back(const valtype& vch)
+{
+    // std::vector::push_back copes with vch being one of the slots
+    if (nSize == vSlots.size())
+        vSlots.push_back(vch);
+    else
+        vSlots[nSize].assign(vch.begin(), vch.end());
+    nSize++;
+}
+
+void CScriptStack::push_back(valtype&& vch)
+{
+    if (nSize == vSlots.size())
+        vSlots.push_back(std::move(vch));
+    else
+        vSlots[nSize].swap(vch);
+    nSize++;
+}
+
+void CScriptStack::push_back(const unsigned char* first, const unsigned char* last)
+{
+    if (nSize == vSlots.size())
+        vSlots.emplace_back(first, last);
+    else
+        vSlots[nSize].assign(first, last);
+    nSize++;
+}
+
+CScriptStack::iterator CScriptStack::insert(iterator pos, const valtype& vch)
+{
+    size_t nPos = pos - begin();
+    push_back(vch);
+    std::rotate(begin() + nPos, end() - 1, end());
+    return begin() + nPos;
+}
+
+CScriptStack::iterator CScriptStack::erase(iterator first, iterator last)
+{
+    // Move the erased elements behind the stack, where they keep their buffers
+    size_t nPos = first - begin();
+    size_t nCount = last - first;
+    std::rotate(first, last, end());
+    nSize -= nCount;
+    return begin() + nPos;
+}
+
+namespace {
+
+/**
+ * Matches OP_m <pubkey>... OP_n OP_CHECKMULTISIG with 1 <= m <= n <= 16 and
+ * directly pushed keys of 33 to 65 bytes, like Solver's TX_MULTISIG template,
+ * and puts the keys into vPubKeys.
+ */
+bool MatchMultisig(const CScript& script, int& nRequired, CScriptStack& vPubKeys)
+{
+    vPubKeys.clear();
+    if (script.size() < 3 || script.back() != OP_CHECKMULTISIG)
+        return false;
+    opcodetype opcode = (opcodetype)script[0];
+    if (opcode < OP_1 || opcode > OP_16)
+        return false;
+    nRequired = CScript::DecodeOP_N(opcode);
+
+    const unsigned char* pc = &script[1];
+    const unsigned char* pend = &script[script.size() - 2];
+    while (pc < pend) {
+        unsigned int nKeySize = *pc;
+        if (nKeySize < 33 || nKeySize > 65 || (unsigned int)(pend - pc) <= nKeySize)
+            return false;
+        vPubKeys.push_back(pc + 1, pc + 1 + nKeySize);
+        pc += 1 + nKeySize;
+    }
+    opcode = (opcodetype)*pend;
+    if (pc != pend || opcode < OP_1 || opcode > OP_16)
+        return false;
+    return CScript::DecodeOP_N(opcode) == (int)vPubKeys.size() && nRequired <= (int)vPubKeys.size();
+}
+
+/** OP_CHECKSIG as the only signature opcode of scriptCode, followed by the check of its result */
+bool CheckSigAsScript(const valtype& vchSig, const valtype& vchPubKey, const CScript& scriptCodeIn, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    CScript scriptCode(scriptCodeIn);
+    scriptCode.FindAndDelete(CScript(vchSig));
+
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror))
+        // serror is set
+        return false;
+    if (!checker.CheckSig(vchSig, vchPubKey, scriptCode))
+        return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return set_success(serror);
+}
+
+/**
+ * OP_CHECKMULTISIG as the only signature opcode of scriptCode, followed by the
+ * check of its result. The dummy element and the signatures are at the bottom
+ * of stack; the signatures are tried in the same order as EvalScript does.
+ */
+bool CheckMultisigAsScript(const CScriptStack& stack, int nSigsCount, const CScriptStack& vPubKeys, const CScript& scriptCodeIn, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    CScriptStack::const_iterator itSigs = stack.begin() + 1;
+    int nKeysCount = vPubKeys.size();
+
+    CScript scriptCode(scriptCodeIn);
+    for (int k = nSigsCount - 1; k >= 0; k--)
+        scriptCode.FindAndDelete(CScript(itSigs[k]));
+
+    int isig = nSigsCount - 1;
+    int ikey = nKeysCount - 1;
+    bool fSuccess = true;
+    while (fSuccess && nSigsCount > 0) {
+        const valtype& vchSig = itSigs[isig];
+        const valtype& vchPubKey = vPubKeys.begin()[ikey];
+        if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror))
+            // serror is set
+            return false;
+
+        if (checker.CheckSig(vchSig, vchPubKey, scriptCode)) {
+            isig--;
+            nSigsCount--;
+        }
+        ikey--;
+        nKeysCount--;
+
+        if (nSigsCount > nKeysCount)
+            fSuccess = false;
+    }
+
+    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stack.begin()->size())
+        return set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+    if (!fSuccess)
+        return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return set_success(serror);
+}
+
+/**
+ * Verifies a P2PKH, P2PK, multisig or (with SCRIPT_VERIFY_P2SH) P2SH multisig
+ * scriptPubKey against the stack its scriptSig left, without running it
+ * through EvalScript. The checks are the ones EvalScript and VerifyScript do,
+ * in the same order, so fResult and serror come out the same. Returns false
+ * if the scriptPubKey is none of these, or the stack does not have the shape
+ * it expects; then the interpreter has to run it.
+ */
+bool VerifyStandardScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, CScriptStacks& stacks, bool& fResult, ScriptError* serror)
+{
+    const CScriptStack& stack = stacks.stack;
+    const size_t nScriptSize = scriptPubKey.size();
+    int nRequired;
+
+    // OP_DUP OP_HASH160 <pubkeyhash> OP_EQUALVERIFY OP_CHECKSIG
+    if (nScriptSize == 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 20 &&
+        scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG) {
+        if (stack.size() != 2)
+            return false;
+        const valtype& vchSig = stack.begin()[0];
+        const valtype& vchPubKey = stack.begin()[1];
+        unsigned char vchHash[20];
+        CHash160().Write(begin_ptr(vchPubKey), vchPubKey.size()).Finalize(vchHash);
+        if (memcmp(vchHash, &scriptPubKey[3], sizeof(vchHash)) != 0)
+            fResult = set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+        else
+            fResult = CheckSigAsScript(vchSig, vchPubKey, scriptPubKey, flags, checker, serror);
+        return true;
+    }
+
+    // <pubkey> OP_CHECKSIG
+    if (nScriptSize >= 35 && nScriptSize <= 67 && scriptPubKey[0] == nScriptSize - 2 && scriptPubKey.back() == OP_CHECKSIG) {
+        if (stack.size() != 1)
+            return false;
+        stacks.keys.clear();
+        stacks.keys.push_back(&scriptPubKey[1], &scriptPubKey[1] + nScriptSize - 2);
+        fResult = CheckSigAsScript(stack.back(), stacks.keys.back(), scriptPubKey, flags, checker, serror);
+        return true;
+    }
+
+    // OP_m <pubkey>... OP_n OP_CHECKMULTISIG
+    if (MatchMultisig(scriptPubKey, nRequired, stacks.keys)) {
+        if (stack.size() != (size_t)nRequired + 1)
+            return false;
+        fResult = CheckMultisigAsScript(stack, nRequired, stacks.keys, scriptPubKey, flags, checker, serror);
+        return true;
+    }
+
+    // OP_HASH160 <scripthash> OP_EQUAL, with a multisig redeem script on top of the stack
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+        if (stack.empty())
+            return false;
+        const valtype& vchRedeemScript = stack.back();
+        CScript redeemScript(vchRedeemScript.begin(), vchRedeemScript.end());
+        if (!MatchMultisig(redeemScript, nRequired, stacks.keys) || stack.size() != (size_t)nRequired + 2)
+            return false;
+        unsigned char vchHash[20];
+        CHash160().Write(begin_ptr(vchRedeemScript), vchRedeemScript.size()).Finalize(vchHash);
+        if (memcmp(vchHash, &scriptPubKey[2], sizeof(vchHash)) != 0)
+            fResult = set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+        else if (!scriptSig.IsPushOnly())
+            fResult = set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
+        else
+            fResult = CheckMultisigAsScript(stack, nRequired, stacks.keys, redeemScript, flags, checker, serror);
+        return true;
+    }
+
+    return false;
+}
+
+} // anon namespace
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    CScriptStacks stacks;
+    return VerifyScript(scriptSig, scriptPubKey, flags, checker, stacks, serror);
+}
+
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, CScriptStacks& stacks, ScriptError* serror)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
 
@@ -1093,13 +1475,22 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    vector<vector<unsigned char> > stack, stackCopy;
-    if (!EvalScript(stack, scriptSig, flags, checker, serror))
+    CScriptStack& stack = stacks.stack;
+    CScriptStack& stackCopy = stacks.stackCopy;
+    stack.clear();
+    if (!EvalScriptImpl(stack, stacks.altstack, stacks.vfExec, scriptSig, flags, checker, serror))
         // serror is set
         return false;
-    if (flags & SCRIPT_VERIFY_P2SH)
+
+    // Standard scripts, the bulk of what blocks spend, go straight to their signature checks
+    bool fResult;
+    if (VerifyStandardScript(scriptSig, scriptPubKey, flags, checker, stacks, fResult, serror))
+        return fResult;
+
+    // Only a P2SH redeem script is evaluated against the copy
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash())
         stackCopy = stack;
-    if (!EvalScript(stack, scriptPubKey, flags, checker, serror))
+    if (!EvalScriptImpl(stack, stacks.altstack, stacks.vfExec, scriptPubKey, flags, checker, serror))
         // serror is set
         return false;
     if (stack.empty())
@@ -1124,7 +1515,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
         popstack(stackCopy);
 
-        if (!EvalScript(stackCopy, pubKey2, flags, checker, serror))
+        if (!EvalScriptImpl(stackCopy, stacks.altstack, stacks.vfExec, pubKey2, flags, checker, serror))
             // serror is set
             return false;
         if (stackCopy.empty())
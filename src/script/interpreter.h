@@ -7,6 +7,7 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 
 #include <vector>
@@ -72,7 +73,38 @@ enum
 
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * The parts of the signature hash serialization of a transaction that are the
+ * same for all its inputs, so that hashing for every input doesn't serialize
+ * the whole transaction again. Signatures only commit to the scripts of the
+ * inputs they sign, so this stays valid while the inputs are being signed.
+ */
+class PrecomputedTransactionData
+{
+public:
+    int32_t nVersion;
+    uint32_t nLockTime;
+    //! The inputs as serialized for the hashes of the other inputs (prevout, empty script, nSequence)
+    std::vector<unsigned char> vBlankedInputs;
+    //! The outputs as serialized, and where each of them starts (with the end at the back)
+    std::vector<unsigned char> vOutputs;
+    std::vector<unsigned int> vOutputPos;
+    //! SIGHASH_ALL hash state up to each input: nVersion and the blanked inputs in front of it
+    std::vector<CSHA256> vPrefix;
+
+    explicit PrecomputedTransactionData(const CTransaction& tx);
+    explicit PrecomputedTransactionData(const CMutableTransaction& tx);
+
+    unsigned int GetInputCount() const { return vPrefix.size(); }
+    unsigned int GetOutputCount() const { return vOutputPos.size() - 1; }
+
+private:
+    template <typename T>
+    void Init(const T& tx);
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata = nullptr);
+uint256 SignatureHash(const CScript& scriptCode, const PrecomputedTransactionData& txdata, unsigned int nIn, int nHashType);
 
 class BaseSignatureChecker
 {
@@ -85,17 +117,19 @@ public:
     virtual ~BaseSignatureChecker() {}
 };
 
+/** Checks signatures of input nIn of txTo; txTo may be null if txdata is given, which is all signature hashes need */
 class TransactionSignatureChecker : public BaseSignatureChecker
 {
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = nullptr) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
 
@@ -108,7 +142,70 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
 };
 
+/**
+ * Stack of the script interpreter that keeps the buffers of popped elements
+ * for later pushes: once it has held as many elements, of the sizes a script
+ * pushes, evaluating that kind of script again allocates nothing. How much it
+ * keeps is bounded by the interpreter's limits on element size and stack depth.
+ * Supports the part of the std::vector interface EvalScript uses.
+ */
+class CScriptStack
+{
+private:
+    //! The elements below nSize are on the stack, the others are only kept for their buffers
+    std::vector<std::vector<unsigned char> > vSlots;
+    size_t nSize;
+
+public:
+    typedef std::vector<std::vector<unsigned char> >::iterator iterator;
+    typedef std::vector<std::vector<unsigned char> >::const_iterator const_iterator;
+
+    CScriptStack() : nSize(0) {}
+    CScriptStack(const CScriptStack& other) : nSize(0) { *this = other; }
+    //! Copies the elements of other into the buffers of this stack
+    CScriptStack& operator=(const CScriptStack& other);
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    iterator begin() { return vSlots.begin(); }
+    iterator end() { return vSlots.begin() + nSize; }
+    const_iterator begin() const { return vSlots.begin(); }
+    const_iterator end() const { return vSlots.begin() + nSize; }
+
+    std::vector<unsigned char>& at(size_t nPos);
+    std::vector<unsigned char>& back() { return vSlots[nSize - 1]; }
+    const std::vector<unsigned char>& back() const { return vSlots[nSize - 1]; }
+
+    //! vch may be an element of this stack
+    void push_back(const std::vector<unsigned char>& vch);
+    void push_back(std::vector<unsigned char>&& vch);
+    //! Pushes the bytes [first, last), which must not be in this stack
+    void push_back(const unsigned char* first, const unsigned char* last);
+    void pop_back() { nSize--; }
+    iterator insert(iterator pos, const std::vector<unsigned char>& vch);
+    iterator erase(iterator first, iterator last);
+    iterator erase(iterator pos) { return erase(pos, pos + 1); }
+    void clear() { nSize = 0; }
+};
+
+/**
+ * The stacks VerifyScript evaluates scripts with. Keeping one around to verify
+ * many scripts with, like a script check thread does, reuses their buffers.
+ */
+struct CScriptStacks
+{
+    CScriptStack stack;
+    //! Copy of the stack after the scriptSig, evaluated against a P2SH redeem script
+    CScriptStack stackCopy;
+    CScriptStack altstack;
+    std::vector<bool> vfExec;
+    //! Public keys of a standard scriptPubKey or redeem script verified without the interpreter
+    CScriptStack keys;
+};
+
+bool CastToBool(const std::vector<unsigned char>& vch);
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = nullptr);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = nullptr);
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, CScriptStacks& stacks, ScriptError* error = nullptr);
 
 #endif // BITCOIN_SCRIPT_INTERPRETER_H
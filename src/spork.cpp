@@ -59,13 +59,12 @@ void LoadSporksFromDB()
     }
 }
 
-void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+void ProcessSpork(CNode* pfrom, std::string& strCommand, CPlainDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all masternode related functionality
 
     if (strCommand == "spork") {
         //LogPrintf("ProcessSpork::spork\n");
-        CDataStream vMsg(vRecv);
         CSporkMessage spork;
         vRecv >> spork;
 
@@ -8,9 +8,11 @@
 
 
 
+#include "chainparams.h"
 #include "clientversion.h"
 #include "main.h"
 #include "utiltime.h"
+#include "test/test_bitgreen.h"
 
 #include <cstdio>
 
@@ -66,4 +68,33 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+BOOST_FIXTURE_TEST_CASE(CheckBlockContents_memo, TestingSetup)
+{
+    // A block built from a header starts out unchecked
+    const CBlock& genesis = Params().GenesisBlock();
+    CBlock block(genesis.GetBlockHeader());
+    block.vtx = genesis.vtx;
+    BOOST_CHECK(!block.fChecked);
+
+    // Checks without PoW and merkle root, as in TestBlockValidity, are not remembered
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, false, false));
+    BOOST_CHECK(!block.fChecked);
+
+    BOOST_CHECK(CheckBlockContents(block, state));
+    BOOST_CHECK(block.fChecked);
+
+    // Once remembered, the contents are not looked at again
+    block.vtx.push_back(block.vtx[0]);
+    BOOST_CHECK(CheckBlockContents(block, state));
+    BOOST_CHECK(state.IsValid());
+
+    CBlock blockCopy(block.GetBlockHeader());
+    blockCopy.vtx = block.vtx;
+    BOOST_CHECK(!blockCopy.fChecked);
+    BOOST_CHECK(!CheckBlockContents(blockCopy, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txnmrklroot");
+    BOOST_CHECK(!blockCopy.fChecked);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
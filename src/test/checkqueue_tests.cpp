@@ -0,0 +1,125 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "random.h"
+
+#include <atomic>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+static std::atomic<unsigned int> nChecksRun(0);
+
+struct FakeCheck {
+    bool fOk;
+
+    FakeCheck(bool fOkIn = true) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        nChecksRun++;
+        return fOk;
+    }
+
+    void swap(FakeCheck& check)
+    {
+        std::swap(fOk, check.fOk);
+    }
+};
+
+//! A check that takes at least a known time
+struct SlowCheck {
+    bool operator()()
+    {
+        boost::this_thread::sleep_for(boost::chrono::microseconds(200));
+        return true;
+    }
+
+    void swap(SlowCheck& check) {}
+};
+
+static void RunRounds(CCheckQueue<FakeCheck>& queue, int nRounds)
+{
+    for (int i = 0; i < nRounds; i++) {
+        bool fFail = insecure_rand() % 4 == 0;
+        unsigned int nFailAt = 0;
+        unsigned int nTotal = 0;
+        nChecksRun = 0;
+        {
+            CCheckQueueControl<FakeCheck> control(&queue);
+            // Transactions of 1 to 300 inputs, added while the workers already run checks
+            for (int nTx = insecure_rand() % 50; nTx > 0; nTx--) {
+                std::vector<FakeCheck> vChecks(1 + insecure_rand() % 300);
+                if (fFail && nFailAt == 0 && insecure_rand() % 8 == 0) {
+                    nFailAt = nTotal + 1 + insecure_rand() % vChecks.size();
+                    vChecks[nFailAt - nTotal - 1].fOk = false;
+                }
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK_EQUAL(control.Wait(), nFailAt == 0);
+        }
+        // Every check runs unless one failed, after which the rest may be skipped
+        if (nFailAt == 0)
+            BOOST_CHECK_EQUAL(nChecksRun, nTotal);
+        else
+            BOOST_CHECK(nChecksRun <= nTotal);
+        BOOST_CHECK(queue.IsIdle());
+
+        // Every added check is taken exactly once, in batches of 1 to 128
+        CCheckQueueStats stats = queue.GetStats();
+        BOOST_CHECK_EQUAL(stats.nBatchChecks, nTotal);
+        BOOST_CHECK(stats.nSteals <= stats.nBatches);
+        if (nTotal == 0) {
+            BOOST_CHECK_EQUAL(stats.nBatches, 0U);
+        } else {
+            BOOST_CHECK(stats.nMinBatch >= 1);
+            BOOST_CHECK(stats.nMinBatch <= stats.nMaxBatch);
+            BOOST_CHECK(stats.nMaxBatch <= 128);
+            BOOST_CHECK(stats.nBatches * stats.nMaxBatch >= nTotal);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_workers)
+{
+    CCheckQueue<FakeCheck> queue(128, 4);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<FakeCheck>::Thread, &queue));
+
+    RunRounds(queue, 200);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_master_only)
+{
+    // Without workers the master runs every check itself in Wait()
+    CCheckQueue<FakeCheck> queue(128, 4);
+    RunRounds(queue, 50);
+    BOOST_CHECK_EQUAL(queue.GetStats().nSteals, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_batch_cost)
+{
+    // Once a check is known to take 200us, batches hold no more than 1ms of work
+    CCheckQueue<SlowCheck> queue(128, 4);
+    for (int nRound = 0; nRound < 2; nRound++) {
+        CCheckQueueControl<SlowCheck> control(&queue);
+        std::vector<SlowCheck> vChecks(40);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    CCheckQueueStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBatchChecks, 40U);
+    BOOST_CHECK(stats.nMaxBatch <= 5);
+    BOOST_CHECK(stats.nBatches >= 8);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
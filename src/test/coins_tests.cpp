@@ -3,8 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "coinsprefetch.h"
+#include "coinswritebehind.h"
+#include "main.h"
 #include "random.h"
 #include "uint256.h"
+#include "utiltime.h"
 
 #include <vector>
 #include <map>
@@ -41,7 +45,7 @@ public:
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             map_[it->first] = it->second.coins;
@@ -56,7 +60,42 @@ public:
         return true;
     }
 
-    bool GetStats(CCoinsStats& stats) const { return false; }
+    bool GetTally(CCoinsTally& tally) const
+    {
+        // Always recomputed from scratch, to compare with incrementally maintained tallies
+        tally = CCoinsTally();
+        for (std::map<uint256, CCoins>::const_iterator it = map_.begin(); it != map_.end(); ++it)
+            tally.AddCoins(it->first, it->second);
+        return true;
+    }
+};
+
+//! Coins view that can be read from several threads at once and leaves written maps alone, like the coins database
+class CCoinsViewLocked : public CCoinsViewBacked
+{
+    mutable boost::mutex mutex;
+
+public:
+    CCoinsViewLocked(CCoinsView* viewIn) : CCoinsViewBacked(viewIn) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return CCoinsViewBacked::GetCoins(txid, coins);
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return CCoinsViewBacked::HaveCoins(txid);
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap mapCopy(mapCoins);
+        return CCoinsViewBacked::BatchWrite(mapCopy, hashBlock, tally);
+    }
 };
 }
 
@@ -175,4 +214,176 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+static void CheckTallyEqual(const CCoinsTally& a, const CCoinsTally& b)
+{
+    BOOST_CHECK_EQUAL(a.nTransactions, b.nTransactions);
+    BOOST_CHECK_EQUAL(a.nTransactionOutputs, b.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(a.nSerializedSize, b.nSerializedSize);
+    BOOST_CHECK_EQUAL(a.nTotalAmount, b.nTotalAmount);
+    uint256 hashA, hashB;
+    a.muhash.Finalize(hashA.begin());
+    b.muhash.Finalize(hashB.begin());
+    BOOST_CHECK(hashA == hashB);
+}
+
+// UpdateCoins keeps the statistics delta of the cache in sync with the coins
+// it writes, across a stack of caches.
+BOOST_AUTO_TEST_CASE(coins_tally_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+    CValidationState state;
+    CTxUndo undo;
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vout.resize(3);
+    for (unsigned int i = 0; i < tx1.vout.size(); i++) {
+        tx1.vout[i].nValue = (i + 1) * COIN;
+        tx1.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    BOOST_CHECK(CTransaction(tx1).IsCoinBase());
+    UpdateCoins(tx1, state, cache, undo, 1);
+
+    {
+        CCoinsViewCache child(&cache);
+        CMutableTransaction tx2;
+        tx2.vin.resize(2);
+        tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+        tx2.vin[1].prevout = COutPoint(tx1.GetHash(), 2);
+        tx2.vout.resize(2);
+        tx2.vout[0].nValue = 3 * COIN;
+        tx2.vout[1].nValue = COIN / 2;
+        UpdateCoins(tx2, state, child, undo, 2);
+
+        CMutableTransaction tx3;
+        tx3.vin.resize(1);
+        tx3.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+        tx3.vout.resize(1);
+        tx3.vout[0].nValue = 2 * COIN;
+        UpdateCoins(tx3, state, child, undo, 2);
+        BOOST_CHECK(child.Flush());
+    }
+
+    CCoinsTally incremental, scanned;
+    BOOST_CHECK(cache.GetTally(incremental));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(base.GetTally(scanned));
+    CheckTallyEqual(incremental, scanned);
+    BOOST_CHECK_EQUAL(scanned.nTransactions, 3);
+    BOOST_CHECK_EQUAL(scanned.nTransactionOutputs, 3);
+    BOOST_CHECK_EQUAL(scanned.nTotalAmount, 2 * COIN + COIN / 2 + 2 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(coins_prefetch)
+{
+    CCoinsViewTest base;
+    CCoinsViewLocked locked(&base);
+    CCoinsViewPrefetch prefetch(&locked, 1 << 20, 2);
+
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 50; i++)
+        vTxids.push_back(GetRandHash());
+    std::map<uint256, CAmount> mapValues;
+
+    uint64_t nLookups = 0;
+    for (int i = 0; i < 500; i++) {
+        // Reads of coins that are being written must not bring back the old version
+        prefetch.Prefetch(vTxids);
+        for (int j = 0; j < 5; j++) {
+            const uint256& txid = vTxids[insecure_rand() % vTxids.size()];
+            CCoinsMap mapCoins;
+            CCoinsCacheEntry& entry = mapCoins[txid];
+            entry.coins.vout.resize(1);
+            entry.coins.vout[0].nValue = 1 + insecure_rand() % COIN;
+            entry.coins.nHeight = i;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            mapValues[txid] = entry.coins.vout[0].nValue;
+            BOOST_CHECK(prefetch.BatchWrite(mapCoins, uint256(), CCoinsTally()));
+        }
+        for (int j = 0; j < 10; j++) {
+            const uint256& txid = vTxids[insecure_rand() % vTxids.size()];
+            CCoins coins;
+            bool fFound = prefetch.GetCoins(txid, coins);
+            nLookups++;
+            BOOST_CHECK_EQUAL(fFound, mapValues.count(txid) != 0);
+            if (fFound)
+                BOOST_CHECK_EQUAL(coins.vout[0].nValue, mapValues[txid]);
+        }
+    }
+    uint64_t nHits = 0, nMisses = 0;
+    prefetch.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits + nMisses, nLookups);
+
+    // Nothing fits in an empty budget, so every lookup goes to the base view
+    CCoinsViewPrefetch prefetchNone(&locked, 0, 2);
+    prefetchNone.Prefetch(vTxids);
+    MilliSleep(50);
+    for (const uint256& txid : vTxids) {
+        CCoins coins;
+        BOOST_CHECK_EQUAL(prefetchNone.GetCoins(txid, coins), mapValues.count(txid) != 0);
+    }
+    prefetchNone.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 0U);
+    BOOST_CHECK_EQUAL(nMisses, vTxids.size());
+}
+
+BOOST_AUTO_TEST_CASE(coins_writebehind)
+{
+    CCoinsViewTest base;
+    CCoinsViewLocked locked(&base);
+    CCoinsViewWriteBehind writer(&locked);
+    CCoinsViewCache cache(&writer);
+    // The base view draws from insecure_rand() on the writer thread
+
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 50; i++)
+        vTxids.push_back(GetRandHash());
+    std::map<uint256, CAmount> mapValues;
+    uint256 hashFlushed;
+
+    for (int i = 0; i < 300; i++) {
+        for (int j = 0; j < 5; j++) {
+            const uint256& txid = vTxids[GetRand(vTxids.size())];
+            CCoinsModifier coins = cache.ModifyCoins(txid);
+            if (GetRand(4) == 0) {
+                coins->Clear();
+                mapValues.erase(txid);
+            } else {
+                coins->vout.resize(1);
+                coins->vout[0].nValue = 1 + GetRand(COIN);
+                coins->nHeight = i;
+                mapValues[txid] = coins->vout[0].nValue;
+            }
+        }
+        uint256 hashBlock = GetRandHash();
+        cache.SetBestBlock(hashBlock);
+        if (GetRand(8) == 0) {
+            // Returns before the changes are written; later lookups see them anyway
+            BOOST_CHECK(cache.Flush());
+            hashFlushed = hashBlock;
+            BOOST_CHECK(writer.GetBestBlock() == hashFlushed);
+        }
+        for (const uint256& txid : vTxids) {
+            const CCoins* coins = cache.AccessCoins(txid);
+            BOOST_CHECK_EQUAL(coins && !coins->IsPruned(), mapValues.count(txid) != 0);
+            if (coins && !coins->IsPruned())
+                BOOST_CHECK_EQUAL(coins->vout[0].nValue, mapValues[txid]);
+        }
+    }
+
+    // Once synced, the base view holds everything that was flushed
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK(!writer.HasFailed());
+    for (const uint256& txid : vTxids) {
+        CCoins coins;
+        bool fFound = base.GetCoins(txid, coins) && !coins.IsPruned();
+        BOOST_CHECK_EQUAL(fFound, mapValues.count(txid) != 0);
+        if (fFound)
+            BOOST_CHECK_EQUAL(coins.vout[0].nValue, mapValues[txid]);
+    }
+    BOOST_CHECK(base.GetBestBlock() == cache.GetBestBlock());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
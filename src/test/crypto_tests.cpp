@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/muhash.h"
 #include "crypto/rfc6979_hmac_sha256.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
@@ -10,6 +11,7 @@
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
 #include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
 
 #include <vector>
@@ -282,4 +284,59 @@ BOOST_AUTO_TEST_CASE(rfc6979_hmac_sha256)
             ("7597887cbd76321f32e30440679a22cf7f8d9d2eac390e581fea091ce202ba94"));
 }
 
+static std::vector<unsigned char> MuHashFinalize(const MuHash3072& muhash)
+{
+    std::vector<unsigned char> out(MuHash3072::OUTPUT_SIZE);
+    muhash.Finalize(&out[0]);
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // a * a^-1 == 1 for a value close to the modulus
+    unsigned char data[Num3072::BYTE_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = 0xff - (i % 7);
+    Num3072 a(data), one, inv = a.GetInverse();
+    inv.Multiply(a);
+    BOOST_CHECK(memcmp(inv.limbs, one.limbs, sizeof(one.limbs)) == 0);
+
+    std::vector<std::vector<unsigned char> > elements;
+    for (int i = 0; i < 4; i++) {
+        uint256 element = GetRandHash();
+        elements.push_back(std::vector<unsigned char>(element.begin(), element.end()));
+    }
+
+    // Order does not matter, removing undoes inserting
+    MuHash3072 acc, reversed, removed;
+    for (int i = 0; i < 4; i++) {
+        acc.Insert(&elements[i][0], elements[i].size());
+        reversed.Insert(&elements[3 - i][0], elements[3 - i].size());
+    }
+    BOOST_CHECK(MuHashFinalize(acc) == MuHashFinalize(reversed));
+    removed = acc;
+    removed.Remove(&elements[1][0], elements[1].size());
+    BOOST_CHECK(MuHashFinalize(removed) != MuHashFinalize(acc));
+    removed.Insert(&elements[1][0], elements[1].size());
+    BOOST_CHECK(MuHashFinalize(removed) == MuHashFinalize(acc));
+    BOOST_CHECK(MuHashFinalize(MuHash3072()) != MuHashFinalize(acc));
+
+    // Combining sets: (x * y) / y == x
+    MuHash3072 x, y;
+    x.Insert(&elements[0][0], elements[0].size());
+    y.Insert(&elements[2][0], elements[2].size()).Remove(&elements[3][0], elements[3].size());
+    MuHash3072 z = x;
+    z *= y;
+    z /= y;
+    BOOST_CHECK(MuHashFinalize(z) == MuHashFinalize(x));
+
+    // Serialization round trip
+    CDataStream ss(SER_DISK, 0);
+    ss << y;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 y2;
+    ss >> y2;
+    BOOST_CHECK(MuHashFinalize(y2) == MuHashFinalize(y));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,286 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "prevector.h"
+#include "random.h"
+#include "serialize.h"
+#include "streams.h"
+
+#include "test/test_bitgreen.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(prevector_tests, TestingSetup)
+
+template <unsigned int N, typename T>
+class prevector_tester
+{
+    typedef std::vector<T> realtype;
+    realtype real_vector;
+
+    typedef prevector<N, T> pretype;
+    pretype pre_vector;
+
+    typedef typename pretype::size_type Size;
+
+    void test()
+    {
+        const pretype& const_pre_vector = pre_vector;
+        BOOST_CHECK_EQUAL(real_vector.size(), pre_vector.size());
+        BOOST_CHECK_EQUAL(real_vector.empty(), pre_vector.empty());
+        BOOST_CHECK_EQUAL(pre_vector.allocated_memory() == 0, pre_vector.capacity() == N);
+        for (Size s = 0; s < real_vector.size(); s++) {
+            BOOST_CHECK(real_vector[s] == pre_vector[s]);
+            BOOST_CHECK(&(pre_vector[s]) == &(pre_vector.begin()[s]));
+            BOOST_CHECK(&(pre_vector[s]) == &*(pre_vector.begin() + s));
+            BOOST_CHECK(&(pre_vector[s]) == &*((pre_vector.end() + s) - real_vector.size()));
+        }
+        BOOST_CHECK(pretype(real_vector.begin(), real_vector.end()) == pre_vector);
+        BOOST_CHECK(pretype(pre_vector.begin(), pre_vector.end()) == pre_vector);
+        size_t pos = 0;
+        for (const T& v : pre_vector) {
+            BOOST_CHECK(v == real_vector[pos++]);
+        }
+        pos = 0;
+        for (typename pretype::const_iterator it = const_pre_vector.begin(); it != const_pre_vector.end(); ++it) {
+            BOOST_CHECK(*it == real_vector[pos++]);
+        }
+        CDataStream ss1(SER_DISK, 0);
+        CDataStream ss2(SER_DISK, 0);
+        ss1 << real_vector;
+        ss2 << pre_vector;
+        BOOST_CHECK_EQUAL(ss1.size(), ss2.size());
+        for (Size s = 0; s < ss1.size(); s++) {
+            BOOST_CHECK_EQUAL(ss1[s], ss2[s]);
+        }
+        pretype pre_vector_read;
+        ss2 >> pre_vector_read;
+        BOOST_CHECK(pre_vector_read == pre_vector);
+    }
+
+public:
+    void resize(Size s)
+    {
+        real_vector.resize(s);
+        BOOST_CHECK_EQUAL(real_vector.size(), s);
+        pre_vector.resize(s);
+        BOOST_CHECK_EQUAL(pre_vector.size(), s);
+        test();
+    }
+
+    void reserve(Size s)
+    {
+        real_vector.reserve(s);
+        BOOST_CHECK(real_vector.capacity() >= s);
+        pre_vector.reserve(s);
+        BOOST_CHECK(pre_vector.capacity() >= s);
+        test();
+    }
+
+    void insert(Size position, const T& value)
+    {
+        real_vector.insert(real_vector.begin() + position, value);
+        pre_vector.insert(pre_vector.begin() + position, value);
+        test();
+    }
+
+    void insert(Size position, Size count, const T& value)
+    {
+        real_vector.insert(real_vector.begin() + position, count, value);
+        pre_vector.insert(pre_vector.begin() + position, count, value);
+        test();
+    }
+
+    template <typename I>
+    void insert_range(Size position, I first, I last)
+    {
+        real_vector.insert(real_vector.begin() + position, first, last);
+        pre_vector.insert(pre_vector.begin() + position, first, last);
+        test();
+    }
+
+    //! Insert an element of the vector itself, which may move while growing
+    void insert_own(Size position, Size from)
+    {
+        real_vector.insert(real_vector.begin() + position, real_vector[from]);
+        pre_vector.insert(pre_vector.begin() + position, pre_vector[from]);
+        test();
+    }
+
+    void erase(Size position)
+    {
+        real_vector.erase(real_vector.begin() + position);
+        pre_vector.erase(pre_vector.begin() + position);
+        test();
+    }
+
+    void erase(Size first, Size last)
+    {
+        real_vector.erase(real_vector.begin() + first, real_vector.begin() + last);
+        pre_vector.erase(pre_vector.begin() + first, pre_vector.begin() + last);
+        test();
+    }
+
+    void update(Size pos, const T& value)
+    {
+        real_vector[pos] = value;
+        pre_vector[pos] = value;
+        test();
+    }
+
+    void push_back(const T& value)
+    {
+        real_vector.push_back(value);
+        pre_vector.push_back(value);
+        test();
+    }
+
+    void push_back_own(Size from)
+    {
+        real_vector.push_back(real_vector[from]);
+        pre_vector.push_back(pre_vector[from]);
+        test();
+    }
+
+    void pop_back()
+    {
+        real_vector.pop_back();
+        pre_vector.pop_back();
+        test();
+    }
+
+    void clear()
+    {
+        real_vector.clear();
+        pre_vector.clear();
+    }
+
+    void assign(Size n, const T& value)
+    {
+        real_vector.assign(n, value);
+        pre_vector.assign(n, value);
+        test();
+    }
+
+    void shrink_to_fit()
+    {
+        pre_vector.shrink_to_fit();
+        test();
+    }
+
+    void copy()
+    {
+        pretype pre_vector_copy(pre_vector);
+        BOOST_CHECK(pre_vector_copy == pre_vector);
+        pretype pre_vector_assigned;
+        pre_vector_assigned = pre_vector;
+        BOOST_CHECK(pre_vector_assigned == pre_vector);
+        pre_vector = pre_vector_copy;
+        test();
+    }
+
+    void swap()
+    {
+        pretype pre_vector_other(pre_vector);
+        pre_vector.clear();
+        pre_vector.swap(pre_vector_other);
+        test();
+    }
+
+    void compare(const prevector_tester& other)
+    {
+        BOOST_CHECK_EQUAL(real_vector == other.real_vector, pre_vector == other.pre_vector);
+        BOOST_CHECK_EQUAL(real_vector < other.real_vector, pre_vector < other.pre_vector);
+        BOOST_CHECK_EQUAL(other.real_vector < real_vector, other.pre_vector < pre_vector);
+    }
+
+    Size size() const
+    {
+        return real_vector.size();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(PrevectorTestInt)
+{
+    for (int j = 0; j < 64; j++) {
+        prevector_tester<8, int> test;
+        prevector_tester<8, int> other;
+        for (int i = 0; i < 2048; i++) {
+            uint32_t r = insecure_rand();
+            if ((r % 4) == 0)
+                test.insert(insecure_rand() % (test.size() + 1), insecure_rand());
+            if (test.size() > 0 && ((r >> 2) % 4) == 1)
+                test.erase(insecure_rand() % test.size());
+            if (((r >> 4) % 8) == 2) {
+                int new_size = std::max<int>(0, std::min<int>(30, test.size() + (insecure_rand() % 5) - 2));
+                test.resize(new_size);
+            }
+            if (((r >> 7) % 8) == 3)
+                test.insert(insecure_rand() % (test.size() + 1), 1 + (insecure_rand() % 2), insecure_rand());
+            if (((r >> 10) % 8) == 4) {
+                int del = std::min<int>(test.size(), 1 + (insecure_rand() % 2));
+                int beg = insecure_rand() % (test.size() + 1 - del);
+                test.erase(beg, beg + del);
+            }
+            if (((r >> 13) % 16) == 5)
+                test.push_back(insecure_rand());
+            if (test.size() > 0 && ((r >> 17) % 16) == 6)
+                test.pop_back();
+            if (((r >> 21) % 32) == 7) {
+                int values[4];
+                int num = 1 + (insecure_rand() % 4);
+                for (int k = 0; k < num; k++)
+                    values[k] = insecure_rand();
+                test.insert_range(insecure_rand() % (test.size() + 1), values, values + num);
+            }
+            if (((r >> 26) % 32) == 8) {
+                int del = std::min<int>(test.size(), 1 + (insecure_rand() % 4));
+                int beg = insecure_rand() % (test.size() + 1 - del);
+                test.erase(beg, beg + del);
+            }
+            r = insecure_rand();
+            if (r % 32 == 9)
+                test.reserve(insecure_rand() % 32);
+            if ((r >> 5) % 64 == 10)
+                test.shrink_to_fit();
+            if (test.size() > 0 && (r >> 11) % 16 == 11)
+                test.update(insecure_rand() % test.size(), insecure_rand());
+            if (test.size() > 0 && (r >> 15) % 16 == 12)
+                test.insert_own(insecure_rand() % (test.size() + 1), insecure_rand() % test.size());
+            if (test.size() > 0 && (r >> 19) % 16 == 13)
+                test.push_back_own(insecure_rand() % test.size());
+            if ((r >> 23) % 32 == 14)
+                test.copy();
+            if ((r >> 28) % 16 == 15)
+                test.swap();
+            if (insecure_rand() % 512 == 0)
+                test.assign(insecure_rand() % 32, insecure_rand());
+            if (insecure_rand() % 16 == 0)
+                other = test;
+            if (other.size() > 0 && insecure_rand() % 64 == 0)
+                other.update(insecure_rand() % other.size(), insecure_rand());
+            test.compare(other);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(PrevectorScriptSize)
+{
+    // P2PKH and P2SH scriptPubKeys fit in the inline buffer of a script
+    prevector<28, unsigned char> script(25, (unsigned char)0);
+    BOOST_CHECK_EQUAL(script.allocated_memory(), 0U);
+    script.resize(28);
+    BOOST_CHECK_EQUAL(script.allocated_memory(), 0U);
+    script.push_back(0);
+    BOOST_CHECK(script.allocated_memory() >= 29U);
+    script.resize(23);
+    script.shrink_to_fit();
+    BOOST_CHECK_EQUAL(script.allocated_memory(), 0U);
+    BOOST_CHECK_EQUAL(script.size(), 23U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -189,5 +189,45 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+static void AppendChunk(std::vector<string>& vChunks, const string& strChunk)
+{
+    vChunks.push_back(strChunk);
+}
+
+BOOST_AUTO_TEST_CASE(json_stream_writer)
+{
+    UniValue inner(UniValue::VARR);
+    inner.push_back(1);
+    inner.push_back("two\n");
+    inner.push_back(UniValue(UniValue::VOBJ));
+    inner.push_back(UniValue(UniValue::VARR));
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("a\"b", inner));
+    obj.push_back(Pair("c", NullUniValue));
+    obj.push_back(Pair("d", true));
+    obj.push_back(Pair("e", 1.5));
+
+    // Small output stays buffered and matches UniValue::write()
+    std::vector<string> vChunks;
+    JSONStreamWriter writer(std::bind(&AppendChunk, std::ref(vChunks), std::placeholders::_1));
+    writer.Value(obj);
+    BOOST_CHECK(!writer.Flushed());
+    BOOST_CHECK_EQUAL(writer.ReleaseBuffer(), obj.write());
+    BOOST_CHECK(vChunks.empty());
+
+    // Element-wise output with a tiny chunk size concatenates to the same string
+    JSONStreamWriter writerChunked(std::bind(&AppendChunk, std::ref(vChunks), std::placeholders::_1), 4);
+    writerChunked.BeginObject();
+    for (unsigned int i = 0; i < obj.size(); i++) {
+        writerChunked.Key(obj.getKeys()[i]);
+        writerChunked.Value(obj.getValues()[i]);
+    }
+    writerChunked.EndObject();
+    writerChunked.Flush();
+    BOOST_CHECK(writerChunked.Flushed());
+    BOOST_CHECK(vChunks.size() > 1);
+    BOOST_CHECK_EQUAL(boost::algorithm::join(vChunks, ""), obj.write());
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
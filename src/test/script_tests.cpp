@@ -95,6 +95,44 @@ CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, const CMu
     return txSpend;
 }
 
+/**
+ * VerifyScript done by EvalScript alone, to check that VerifyScript's shortcut
+ * for standard scripts comes to the same result and error
+ */
+bool VerifyScriptByInterpreter(const CScript& scriptSig, const CScript& scriptPubKey, int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    if ((flags & SCRIPT_VERIFY_SIGPUSHONLY) && !scriptSig.IsPushOnly()) {
+        *serror = SCRIPT_ERR_SIG_PUSHONLY;
+        return false;
+    }
+    std::vector<std::vector<unsigned char> > stack, stackCopy;
+    if (!EvalScript(stack, scriptSig, flags, checker, serror))
+        return false;
+    stackCopy = stack;
+    if (!EvalScript(stack, scriptPubKey, flags, checker, serror))
+        return false;
+    if (stack.empty() || !CastToBool(stack.back())) {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    }
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+        if (!scriptSig.IsPushOnly()) {
+            *serror = SCRIPT_ERR_SIG_PUSHONLY;
+            return false;
+        }
+        CScript redeemScript(stackCopy.back().begin(), stackCopy.back().end());
+        stackCopy.pop_back();
+        if (!EvalScript(stackCopy, redeemScript, flags, checker, serror))
+            return false;
+        if (stackCopy.empty() || !CastToBool(stackCopy.back())) {
+            *serror = SCRIPT_ERR_EVAL_FALSE;
+            return false;
+        }
+    }
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
 void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, int flags, bool expect, const std::string& message)
 {
     ScriptError err;
@@ -102,6 +140,16 @@ void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, int flags, bo
     CMutableTransaction tx2 = tx;
     BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&tx, 0), &err) == expect, message);
     BOOST_CHECK_MESSAGE(expect == (err == SCRIPT_ERR_OK), std::string(ScriptErrorString(err)) + ": " + message);
+
+    // Stacks that carry the buffers of every earlier test, like those of a script check thread
+    static CScriptStacks stacks;
+    ScriptError errReused;
+    BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&tx, 0), stacks, &errReused) == expect, message);
+    BOOST_CHECK_MESSAGE(errReused == err, std::string(ScriptErrorString(errReused)) + ": " + message);
+
+    ScriptError errInterpreter;
+    BOOST_CHECK_MESSAGE(VerifyScriptByInterpreter(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&tx, 0), &errInterpreter) == expect, message);
+    BOOST_CHECK_MESSAGE(errInterpreter == err, std::string(ScriptErrorString(errInterpreter)) + ": " + message);
 #if defined(HAVE_CONSENSUS_LIB)
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << tx2;
@@ -270,7 +318,7 @@ public:
 
     TestBuilder& PushRedeem()
     {
-        DoPush(static_cast<std::vector<unsigned char> >(scriptPubKey));
+        DoPush(std::vector<unsigned char>(scriptPubKey.begin(), scriptPubKey.end()));
         return *this;
     }
 
@@ -880,7 +928,7 @@ BOOST_AUTO_TEST_CASE(script_combineSigs)
     combined = CombineSignatures(scriptPubKey, txTo, 0, scriptSigCopy, scriptSig);
     BOOST_CHECK(combined == scriptSigCopy || combined == scriptSig);
     // dummy scriptSigCopy with placeholder, should always choose non-placeholder:
-    scriptSigCopy = CScript() << OP_0 << static_cast<vector<unsigned char> >(pkSingle);
+    scriptSigCopy = CScript() << OP_0 << vector<unsigned char>(pkSingle.begin(), pkSingle.end());
     combined = CombineSignatures(scriptPubKey, txTo, 0, scriptSigCopy, scriptSig);
     BOOST_CHECK(combined == scriptSig);
     combined = CombineSignatures(scriptPubKey, txTo, 0, scriptSig, scriptSigCopy);
@@ -4,6 +4,7 @@
 
 #include "serialize.h"
 #include "streams.h"
+#include "utilstrencodings.h"
 
 #include <stdint.h>
 
@@ -45,6 +46,74 @@ BOOST_AUTO_TEST_CASE(varints)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bigendian32)
+{
+    CDataStream ss(SER_DISK, 0);
+    int n = 0x01020304;
+    ss << BIGENDIAN32(n);
+    BOOST_CHECK_EQUAL(HexStr(ss.begin(), ss.end()), "01020304");
+
+    int m = 0;
+    ss >> BIGENDIAN32(m);
+    BOOST_CHECK_EQUAL(m, n);
+    BOOST_CHECK(ss.empty());
+
+    // Serialized values sort numerically
+    unsigned int a = 255, b = 256;
+    CDataStream ssA(SER_DISK, 0), ssB(SER_DISK, 0);
+    ssA << BIGENDIAN32(a);
+    ssB << BIGENDIAN32(b);
+    BOOST_CHECK(ssA.str() < ssB.str());
+}
+
+BOOST_AUTO_TEST_CASE(spanreader)
+{
+    CDataStream ss(SER_DISK, 0);
+    std::string str = "span";
+    ss << VARINT(300) << str << (uint32_t)7;
+
+    CSpanReader reader(&ss[0], &ss[0] + ss.size(), SER_DISK, 0);
+    int n = 0;
+    std::string str2;
+    reader >> VARINT(n) >> str2;
+    BOOST_CHECK_EQUAL(n, 300);
+    BOOST_CHECK_EQUAL(str2, str);
+    BOOST_CHECK_EQUAL(reader.size(), 4U);
+    reader.ignore(4);
+    BOOST_CHECK(reader.empty());
+
+    // Reads never go past the end of the span
+    char c;
+    BOOST_CHECK_THROW(reader >> c, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(1), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(plaindatastream)
+{
+    CDataStream ss(SER_NETWORK, 0);
+    std::string str = "plain";
+    ss << VARINT(300) << str << (uint32_t)7;
+
+    // Filled the way a received message is: grown first, then copied into
+    CPlainDataStream plain(SER_NETWORK, 0);
+    plain.resize(ss.size());
+    memcpy(&plain[0], &ss[0], ss.size());
+    BOOST_CHECK_EQUAL(plain.str(), ss.str());
+
+    int n = 0;
+    std::string str2;
+    uint32_t u = 0;
+    plain >> VARINT(n) >> str2 >> u;
+    BOOST_CHECK_EQUAL(n, 300);
+    BOOST_CHECK_EQUAL(str2, str);
+    BOOST_CHECK_EQUAL(u, 7U);
+    BOOST_CHECK(plain.empty());
+
+    // An explicit fill value is still honoured
+    plain.resize(3, 'x');
+    BOOST_CHECK_EQUAL(plain.str(), "xxx");
+}
+
 BOOST_AUTO_TEST_CASE(compactsize)
 {
     CDataStream ss(SER_DISK, 0);
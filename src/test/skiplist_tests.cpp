@@ -6,6 +6,7 @@
 #include "random.h"
 #include "util.h"
 
+#include <set>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -99,4 +100,55 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindexmap_test)
+{
+    CBlockIndexMap map;
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex*> vEntries;
+
+    // Enough entries to grow the table and fill several slabs. Hashes that
+    // only differ in their high bits all start probing at the same slot.
+    for (int i=0; i<10000; i++) {
+        vHashes.push_back(i % 2 ? GetRandHash() : ArithToUint256(arith_uint256(i) << 128));
+        CBlockIndex* pindex = map.Allocate();
+        pindex->nHeight = i;
+        std::pair<BlockMap::iterator, bool> ret = map.insert(vHashes[i], pindex);
+        BOOST_CHECK(ret.second);
+        BOOST_CHECK(ret.first->second == pindex);
+        BOOST_CHECK(pindex->GetBlockHash() == vHashes[i]);
+        vEntries.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 10000U);
+
+    // Inserting a known hash keeps the existing entry
+    std::pair<BlockMap::iterator, bool> ret = map.insert(vHashes[42], map.Allocate());
+    BOOST_CHECK(!ret.second);
+    BOOST_CHECK(ret.first->second == vEntries[42]);
+    BOOST_CHECK_EQUAL(map.size(), 10000U);
+
+    // Entries did not move while the table grew
+    for (int i=0; i<10000; i++) {
+        BOOST_CHECK(map[vHashes[i]] == vEntries[i]);
+        BOOST_CHECK(map.find(vHashes[i])->first == vHashes[i]);
+        BOOST_CHECK_EQUAL(map[vHashes[i]]->nHeight, i);
+    }
+    BOOST_CHECK(map.find(GetRandHash()) == map.end());
+    BOOST_CHECK(map[GetRandHash()] == nullptr);
+    BOOST_CHECK_EQUAL(map.count(vHashes[0]), 1U);
+    BOOST_CHECK_EQUAL(map.count(uint256()), 0U);
+
+    // Iteration visits every entry once
+    std::set<const CBlockIndex*> setSeen;
+    for (const BlockMap::value_type& item : map) {
+        BOOST_CHECK(item.first == item.second->GetBlockHash());
+        BOOST_CHECK(setSeen.insert(item.second).second);
+    }
+    BOOST_CHECK_EQUAL(setSeen.size(), 10000U);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(vHashes[0]) == map.end());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
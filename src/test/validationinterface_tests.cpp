@@ -0,0 +1,99 @@
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validationinterface.h"
+#include "primitives/block.h"
+
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(validationinterface_tests)
+
+class CRecordingListener : public CValidationInterface
+{
+public:
+    boost::mutex mutex;
+    std::vector<uint32_t> vLockTimes;
+    std::vector<const CBlock*> vBlocks;
+    bool fOtherThread;
+
+    CRecordingListener() : fOtherThread(false) {}
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        vLockTimes.push_back(tx.nLockTime);
+        vBlocks.push_back(pblock);
+        if (boost::this_thread::get_id() != idTest)
+            fOtherThread = true;
+    }
+
+public:
+    boost::thread::id idTest;
+};
+
+static CTransactionRef MakeTx(uint32_t nLockTime)
+{
+    CMutableTransaction mtx;
+    mtx.nLockTime = nLockTime;
+    return MakeTransactionRef(mtx);
+}
+
+BOOST_AUTO_TEST_CASE(validationinterface_queue_order)
+{
+    CRecordingListener listener;
+    listener.idTest = boost::this_thread::get_id();
+    RegisterValidationInterface(&listener);
+    StartValidationInterfaceQueue();
+
+    // Transactions and blocks come out in the order they went in
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    for (uint32_t i = 0; i < 1000; i++) {
+        if (i % 10 == 9) {
+            pblock->vtx.push_back(MakeTx(i));
+            SyncBlockWithWallets(pblock);
+            pblock = std::make_shared<CBlock>();
+        } else {
+            pblock->vtx.push_back(MakeTx(i));
+            if (i % 10 == 4) {
+                for (const CTransactionRef& ptx : pblock->vtx)
+                    SyncWithWallets(ptx);
+                pblock->vtx.clear();
+            }
+        }
+        if (i % 100 == 50)
+            LimitValidationInterfaceQueue();
+    }
+    SyncWithValidationInterfaceQueue();
+    {
+        boost::unique_lock<boost::mutex> lock(listener.mutex);
+        BOOST_CHECK_EQUAL(listener.vLockTimes.size(), 1000U);
+        for (uint32_t i = 0; i < listener.vLockTimes.size(); i++) {
+            BOOST_CHECK_EQUAL(listener.vLockTimes[i], i);
+            BOOST_CHECK_EQUAL(listener.vBlocks[i] == nullptr, i % 10 < 5);
+        }
+        BOOST_CHECK(listener.fOtherThread);
+    }
+
+    // Once stopped, notifications are delivered before returning
+    StopValidationInterfaceQueue();
+    {
+        boost::unique_lock<boost::mutex> lock(listener.mutex);
+        listener.fOtherThread = false;
+    }
+    SyncWithWallets(MakeTx(1000));
+    {
+        boost::unique_lock<boost::mutex> lock(listener.mutex);
+        BOOST_CHECK_EQUAL(listener.vLockTimes.size(), 1001U);
+        BOOST_CHECK_EQUAL(listener.vLockTimes.back(), 1000U);
+        BOOST_CHECK(!listener.fOtherThread);
+    }
+
+    UnregisterValidationInterface(&listener);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,10 @@
 
 #include "wallet.h"
 
+#include "main.h"
+#include "script/standard.h"
+#include "test/test_bitgreen.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -21,6 +25,8 @@
 
 using namespace std;
 
+extern CWallet* pwalletMain;
+
 typedef set<pair<const CWalletTx*,unsigned int> > CoinSet;
 
 BOOST_AUTO_TEST_SUITE(wallet_tests)
@@ -260,14 +266,35 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
         BOOST_CHECK_EQUAL(nValueRet, 1.01 * COIN);   // we should get 1 + 0.01
         BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
 
+        // an exact subset is found even when no greedy choice leads to it
+        empty_wallet();
+        add_coin(23 * CENT);
+        add_coin(19 * CENT);
+        add_coin(17 * CENT);
+        add_coin(13 * CENT);
+        add_coin(11 * CENT);
+        add_coin(1111 * CENT);
+        BOOST_CHECK( wallet.SelectCoinsMinConf(41 * CENT, 1, 1, vCoins, setCoinsRet, nValueRet));
+        BOOST_CHECK_EQUAL(nValueRet, 41 * CENT);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+        // a subset that exceeds the target by less than a change output is worth is as good as exact
+        empty_wallet();
+        add_coin(4 * CENT);
+        add_coin(3 * CENT);
+        add_coin(2 * CENT + 1000);
+        add_coin(1111 * CENT);
+        BOOST_CHECK( wallet.SelectCoinsMinConf(5 * CENT, 1, 1, vCoins, setCoinsRet, nValueRet));
+        BOOST_CHECK_EQUAL(nValueRet, 5 * CENT + 1000);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
         // test randomness
         {
             empty_wallet();
             for (int i2 = 0; i2 < 100; i2++)
                 add_coin(COIN);
 
-            // picking 50 from 100 coins doesn't depend on the shuffle,
-            // but does depend on randomness in the stochastic approximation code
+            // picking 50 from 100 identical coins depends on the shuffle of coins of the same value
             BOOST_CHECK(wallet.SelectCoinsMinConf(50 * COIN, 1, 6, vCoins, setCoinsRet , nValueRet));
             BOOST_CHECK(wallet.SelectCoinsMinConf(50 * COIN, 1, 6, vCoins, setCoinsRet2, nValueRet));
             BOOST_CHECK(!equal_sets(setCoinsRet, setCoinsRet2));
@@ -305,4 +332,152 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+/** Put a block with txs on top of the active chain, the way ConnectTip leaves the wallet */
+static void ConnectFakeBlock(const std::vector<CMutableTransaction>& vtx)
+{
+    static unsigned int nextTime = 1;
+    CBlock block;
+    {
+        LOCK(cs_main);
+        block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+        block.nTime = nextTime++;
+        BOOST_FOREACH(const CMutableTransaction& tx, vtx)
+            block.vtx.push_back(MakeTransactionRef(tx));
+        block.hashMerkleRoot = block.BuildMerkleTree();
+
+        CBlockIndex* pindex = mapBlockIndex.Allocate();
+        *pindex = CBlockIndex(block);
+        mapBlockIndex.insert(block.GetHash(), pindex);
+        pindex->pprev = chainActive.Tip();
+        pindex->nHeight = pindex->pprev->nHeight + 1;
+        chainActive.SetTip(pindex);
+    }
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
+        pwalletMain->SyncTransaction(*ptx, &block);
+}
+
+/** Take the tip off the active chain, the way DisconnectTip leaves the wallet */
+static void DisconnectFakeBlock(const std::vector<CMutableTransaction>& vtx)
+{
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(chainActive.Tip()->pprev);
+    }
+    BOOST_FOREACH(const CMutableTransaction& tx, vtx)
+        pwalletMain->SyncTransaction(tx, nullptr);
+}
+
+/** The index must hold what a scan of every wallet transaction finds */
+static void CheckUnspentIndex(const std::set<COutPoint>& setExpected)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    std::set<COutPoint> setSpent, setUnspent;
+    BOOST_FOREACH(const PAIRTYPE(const uint256, CWalletTx)& item, pwalletMain->mapWallet) {
+        if (item.second.IsInMainChain()) {
+            BOOST_FOREACH(const CTxIn& txin, item.second.vin)
+                setSpent.insert(txin.prevout);
+        }
+    }
+    BOOST_FOREACH(const PAIRTYPE(const uint256, CWalletTx)& item, pwalletMain->mapWallet) {
+        for (unsigned int i = 0; i < item.second.vout.size(); i++) {
+            COutPoint outpoint(item.first, i);
+            if (pwalletMain->IsMine(item.second.vout[i]) != ISMINE_NO && !setSpent.count(outpoint))
+                setUnspent.insert(outpoint);
+        }
+    }
+    std::set<COutPoint> setIndex = pwalletMain->GetUnspentIndex();
+    BOOST_CHECK(setIndex == setUnspent);
+    BOOST_CHECK(setIndex == setExpected);
+}
+
+BOOST_FIXTURE_TEST_CASE(unspent_index_tests, TestingSetup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptOther = CScript() << OP_TRUE;
+
+    // Two outputs paid to us are confirmed
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFund.vout.resize(3);
+    txFund.vout[0].nValue = 10 * COIN;
+    txFund.vout[0].scriptPubKey = scriptMine;
+    txFund.vout[1].nValue = 20 * COIN;
+    txFund.vout[1].scriptPubKey = scriptMine;
+    txFund.vout[2].nValue = 30 * COIN;
+    txFund.vout[2].scriptPubKey = scriptOther;
+    ConnectFakeBlock(std::vector<CMutableTransaction>(1, txFund));
+    COutPoint fund0(txFund.GetHash(), 0), fund1(txFund.GetHash(), 1);
+    std::set<COutPoint> setExpected;
+    setExpected.insert(fund0);
+    setExpected.insert(fund1);
+    CheckUnspentIndex(setExpected);
+
+    // An unconfirmed transaction paying us adds its output
+    CMutableTransaction txRecv;
+    txRecv.vin.resize(1);
+    txRecv.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txRecv.vout.resize(1);
+    txRecv.vout[0].nValue = 5 * COIN;
+    txRecv.vout[0].scriptPubKey = scriptMine;
+    pwalletMain->SyncTransaction(txRecv, nullptr);
+    setExpected.insert(COutPoint(txRecv.GetHash(), 0));
+    CheckUnspentIndex(setExpected);
+
+    // A spend that is not in the chain, and not in the mempool either, leaves
+    // the output unspent; IsSpent() sorts out unconfirmed spends
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = fund0;
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 9 * COIN;
+    txSpend.vout[0].scriptPubKey = scriptOther;
+    pwalletMain->SyncTransaction(txSpend, nullptr);
+    CheckUnspentIndex(setExpected);
+
+    // Once the spend is confirmed the output goes
+    ConnectFakeBlock(std::vector<CMutableTransaction>(1, txSpend));
+    setExpected.erase(fund0);
+    CheckUnspentIndex(setExpected);
+
+    // A reorg that takes the spend out of the chain brings it back
+    DisconnectFakeBlock(std::vector<CMutableTransaction>(1, txSpend));
+    setExpected.insert(fund0);
+    CheckUnspentIndex(setExpected);
+
+    // A conflicting spend confirmed on the other branch removes it again, and
+    // the first spend stays conflicted without changing anything
+    CMutableTransaction txDoubleSpend = txSpend;
+    txDoubleSpend.vout[0].nValue = 8 * COIN;
+    txDoubleSpend.vout.push_back(CTxOut(1 * COIN, scriptMine));
+    ConnectFakeBlock(std::vector<CMutableTransaction>(1, txDoubleSpend));
+    setExpected.erase(fund0);
+    setExpected.insert(COutPoint(txDoubleSpend.GetHash(), 1));
+    CheckUnspentIndex(setExpected);
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        BOOST_CHECK_EQUAL(pwalletMain->mapWallet[txSpend.GetHash()].GetDepthInMainChain(false), -1);
+    }
+
+    // Spending the change of that spend in the same block as another of our outputs
+    CMutableTransaction txSpend2;
+    txSpend2.vin.resize(2);
+    txSpend2.vin[0].prevout = COutPoint(txDoubleSpend.GetHash(), 1);
+    txSpend2.vin[1].prevout = fund1;
+    txSpend2.vout.resize(1);
+    txSpend2.vout[0].nValue = 20 * COIN;
+    txSpend2.vout[0].scriptPubKey = scriptMine;
+    ConnectFakeBlock(std::vector<CMutableTransaction>(1, txSpend2));
+    setExpected.erase(COutPoint(txDoubleSpend.GetHash(), 1));
+    setExpected.erase(fund1);
+    setExpected.insert(COutPoint(txSpend2.GetHash(), 0));
+    CheckUnspentIndex(setExpected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
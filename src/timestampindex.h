@@ -0,0 +1,59 @@
+// Copyright (c) 2016 BitPay, Inc.
+// Copyright (c) 2019 The BitGreen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TIMESTAMPINDEX_H
+#define BITCOIN_TIMESTAMPINDEX_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+/** Timestamp index entry (-timestampindex): a block of the active chain keyed by its time */
+struct CTimestampIndexKey {
+    unsigned int timestamp;
+    uint256 blockHash;
+
+    CTimestampIndexKey()
+    {
+        SetNull();
+    }
+
+    CTimestampIndexKey(unsigned int time, const uint256& hash)
+    {
+        timestamp = time;
+        blockHash = hash;
+    }
+
+    void SetNull()
+    {
+        timestamp = 0;
+        blockHash.SetNull();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(BIGENDIAN32(timestamp));
+        READWRITE(blockHash);
+    }
+};
+
+/** Prefix of CTimestampIndexKey used to seek to the first block at or after a time */
+struct CTimestampIndexIteratorKey {
+    unsigned int timestamp;
+
+    CTimestampIndexIteratorKey(unsigned int time) : timestamp(time) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(BIGENDIAN32(timestamp));
+    }
+};
+
+#endif // BITCOIN_TIMESTAMPINDEX_H
@@ -6,12 +6,18 @@
 
 #include "txdb.h"
 
+#include "blockstore.h"
+#include "hash.h"
 #include "main.h"
 #include "pow.h"
+#include "random.h"
 #include "uint256.h"
 
+#include <atomic>
+#include <functional>
 #include <stdint.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -20,11 +26,29 @@ static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 'p';
+static const char DB_TIMESTAMPINDEX = 's';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_COINS_STATS = 'S';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'N';
+static const char DB_VERIFY_PROGRESS = 'V';
+
+//! Maximum number of threads decoding the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Number of block index database records decoded at once
+static const size_t BLOCK_INDEX_LOAD_BATCH = 65536;
+
+static const int BLOCK_INDEX_SNAPSHOT_VERSION = 2;
+//! Size of a serialized snapshot record, see WriteSnapshotRecord
+static const size_t BLOCK_INDEX_SNAPSHOT_RECORD_SIZE = 176;
+//! Number of snapshot records covered by one checksum
+static const size_t BLOCK_INDEX_SNAPSHOT_CHUNK = 16384;
 
 void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
 {
@@ -39,7 +63,7 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write(DB_BEST_BLOCK, hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe), fTallyLoaded(false)
 {
 }
 
@@ -61,25 +85,63 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally)
 {
+    if (!LoadTally())
+        return false;
+    CCoinsTally tallyNew = tallyTotal;
+    tallyNew += tally;
+
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    // mapCoins is left as it is, the write-behind layer answers lookups from it until the batch is committed
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             BatchWriteCoins(batch, it->first, it->second.coins);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (!hashBlock.IsNull())
         BatchWriteHashBestChain(batch, hashBlock);
+    batch.Write(DB_COINS_STATS, tallyNew);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+    tallyTotal = tallyNew;
+    return true;
+}
+
+bool CCoinsViewDB::GetTally(CCoinsTally& tally) const
+{
+    if (!LoadTally())
+        return false;
+    tally = tallyTotal;
+    return true;
+}
+
+bool CCoinsViewDB::LoadTally() const
+{
+    if (fTallyLoaded)
+        return true;
+    if (!db.Read(DB_COINS_STATS, tallyTotal)) {
+        LogPrintf("Computing UTXO set statistics, this is only needed once...\n");
+        int64_t nStart = GetTimeMillis();
+        CCoinsTally tally;
+        if (!ComputeTally(tally))
+            return false;
+        // Store right away so an unclean shutdown does not repeat the scan
+        CLevelDBBatch batch;
+        batch.Write(DB_COINS_STATS, tally);
+        if (!const_cast<CLevelDBWrapper&>(db).WriteBatch(batch))
+            return false;
+        tallyTotal = tally;
+        LogPrintf("UTXO set statistics computed: %d transactions, %d outputs (%dms)\n", tally.nTransactions, tally.nTransactionOutputs, GetTimeMillis() - nStart);
+    }
+    fTallyLoaded = true;
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
@@ -110,18 +172,16 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read(DB_LAST_BLOCK, nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+bool CCoinsViewDB::ComputeTally(CCoinsTally& tally) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COINS;
+    pcursor->Seek(ssKeySet.str());
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -129,38 +189,20 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == DB_COINS) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
-            }
+            if (chType != DB_COINS)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            uint256 txhash;
+            ssKey >> txhash;
+            tally.AddCoins(txhash, coins);
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -189,6 +231,173 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey indexKey;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSUNSPENTINDEX)
+                break;
+            ssKey >> indexKey;
+            if (indexKey.type != type || indexKey.hashBytes != addressHash)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue nValue;
+            ssValue >> nValue;
+            unspentOutputs.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (start > 0)
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash, start));
+    else
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey indexKey;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSINDEX)
+                break;
+            ssKey >> indexKey;
+            if (indexKey.type != type || indexKey.hashBytes != addressHash)
+                break;
+            if (end > 0 && indexKey.blockHeight > end)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            addressIndex.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey& timestampIndex)
+{
+    CLevelDBBatch batch;
+    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseTimestampIndex(const CTimestampIndexKey& timestampIndex)
+{
+    CLevelDBBatch batch;
+    batch.Erase(make_pair(DB_TIMESTAMPINDEX, timestampIndex));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256>& vHashes)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CTimestampIndexKey indexKey;
+            ssKey >> chType;
+            if (chType != DB_TIMESTAMPINDEX)
+                break;
+            ssKey >> indexKey;
+            if (indexKey.timestamp > high)
+                break;
+            vHashes.push_back(indexKey.blockHash);
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -203,6 +412,150 @@ bool CBlockTreeDB::ReadFlag(const std::string& name, bool& fValue)
     return true;
 }
 
+bool CBlockTreeDB::WriteVerifyProgress(const uint256& hashTip, int nCheckLevel, int nHeight)
+{
+    return Write(DB_VERIFY_PROGRESS, std::make_pair(hashTip, std::make_pair(nCheckLevel, nHeight)), true);
+}
+
+bool CBlockTreeDB::ReadVerifyProgress(uint256& hashTip, int& nCheckLevel, int& nHeight)
+{
+    std::pair<uint256, std::pair<int, int> > progress;
+    if (!Read(DB_VERIFY_PROGRESS, progress))
+        return false;
+    hashTip = progress.first;
+    nCheckLevel = progress.second.first;
+    nHeight = progress.second.second;
+    return true;
+}
+
+bool CBlockTreeDB::EraseVerifyProgress()
+{
+    if (!Exists(DB_VERIFY_PROGRESS))
+        return true;
+    return Erase(DB_VERIFY_PROGRESS, true);
+}
+
+namespace
+{
+/** Call fn on consecutive ranges of [0, n) of at most nRange elements, from several threads including the calling one */
+void ParallelForRanges(size_t n, size_t nRange, const std::function<void(size_t, size_t)>& fn)
+{
+    std::atomic<size_t> nNext(0);
+    std::function<void()> worker = [&]() {
+        while (true) {
+            size_t nBegin = nNext.fetch_add(nRange);
+            if (nBegin >= n)
+                break;
+            fn(nBegin, std::min(n, nBegin + nRange));
+        }
+    };
+    int nThreads = std::min((int)boost::thread::hardware_concurrency(), MAX_BLOCK_INDEX_LOAD_THREADS);
+    nThreads = std::min(nThreads, (int)((n + nRange - 1) / nRange));
+    boost::thread_group workers;
+    for (int i = 1; i < nThreads; i++)
+        workers.create_thread(worker);
+    worker();
+    workers.join_all();
+}
+
+boost::filesystem::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+void WriteSnapshotRecord(CDataStream& s, const CBlockIndex& index, int32_t nPrev)
+{
+    s << *index.phashBlock << nPrev;
+    s << index.nHeight << index.nStatus << index.nTx << index.nFile << index.nDataPos << index.nUndoPos;
+    s << index.nVersion << index.hashMerkleRoot << index.nTime << index.nBits << index.nNonce;
+    s << index.nMint << index.nMoneySupply << index.nFlags << index.nStakeModifier << index.prevoutStake << index.nStakeTime;
+}
+
+void ReadSnapshotRecord(CSpanReader& s, CBlockIndex& index, uint256& hash, int32_t& nPrev)
+{
+    s >> hash >> nPrev;
+    s >> index.nHeight >> index.nStatus >> index.nTx >> index.nFile >> index.nDataPos >> index.nUndoPos;
+    s >> index.nVersion >> index.hashMerkleRoot >> index.nTime >> index.nBits >> index.nNonce;
+    s >> index.nMint >> index.nMoneySupply >> index.nFlags >> index.nStakeModifier >> index.prevoutStake >> index.nStakeTime;
+}
+
+bool ReadBlockIndexSnapshot(const boost::filesystem::path& path, const uint256& idExpected, const uint256& hashBestChain)
+{
+    // Mapped as a file that is read sequentially
+    CMappedBlockFile file(path, false);
+    if (file.IsNull())
+        return false;
+
+    const size_t nHeaderSize = MESSAGE_START_SIZE + sizeof(int) + 2 * sizeof(uint256) + sizeof(uint64_t);
+    if (file.size() < nHeaderSize)
+        return error("%s : truncated block index snapshot", __func__);
+    int nVersion;
+    uint256 id, hashBest;
+    uint64_t nRecords;
+    CSpanReader header(file.begin() + MESSAGE_START_SIZE, file.begin() + nHeaderSize, SER_DISK, CLIENT_VERSION);
+    header >> nVersion >> id >> hashBest >> nRecords;
+    if (memcmp(file.begin(), Params().MessageStart(), MESSAGE_START_SIZE) != 0 || nVersion != BLOCK_INDEX_SNAPSHOT_VERSION)
+        return error("%s : unknown block index snapshot format", __func__);
+    if (id != idExpected || hashBest != hashBestChain) {
+        LogPrintf("Block index snapshot does not match the block database, ignoring it\n");
+        return false;
+    }
+    uint64_t nChunks = (nRecords + BLOCK_INDEX_SNAPSHOT_CHUNK - 1) / BLOCK_INDEX_SNAPSHOT_CHUNK;
+    if (nRecords == 0 || nRecords > std::numeric_limits<int32_t>::max() ||
+        file.size() != nHeaderSize + nRecords * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE + nChunks * sizeof(uint256))
+        return error("%s : block index snapshot has an unexpected size", __func__);
+    const char* pRecords = file.begin() + nHeaderSize;
+    const char* pChunkHashes = pRecords + nRecords * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE;
+
+    // Check and decode the chunks in parallel, straight into entries of mapBlockIndex
+    mapBlockIndex.reserve(nRecords);
+    std::vector<CBlockIndex*> vIndex(nRecords);
+    for (size_t i = 0; i < nRecords; i++)
+        vIndex[i] = mapBlockIndex.Allocate();
+    std::vector<uint256> vHashes(nRecords);
+    std::vector<int32_t> vPrev(nRecords);
+    std::atomic<bool> fFailed(false);
+    ParallelForRanges(nChunks, 1, [&](size_t nBegin, size_t nEnd) {
+        for (size_t nChunk = nBegin; nChunk < nEnd && !fFailed; nChunk++) {
+            size_t nFirst = nChunk * BLOCK_INDEX_SNAPSHOT_CHUNK;
+            size_t nLast = std::min((size_t)nRecords, nFirst + BLOCK_INDEX_SNAPSHOT_CHUNK);
+            const char* pbegin = pRecords + nFirst * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE;
+            const char* pend = pRecords + nLast * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE;
+            if (memcmp(Hash(pbegin, pend).begin(), pChunkHashes + nChunk * sizeof(uint256), sizeof(uint256)) != 0) {
+                fFailed = true;
+                break;
+            }
+            try {
+                CSpanReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+                for (size_t i = nFirst; i < nLast; i++)
+                    ReadSnapshotRecord(reader, *vIndex[i], vHashes[i], vPrev[i]);
+            } catch (const std::exception&) {
+                fFailed = true;
+            }
+        }
+    });
+
+    // Link the entries; records are sorted by height, so parents come first
+    bool fValid = !fFailed;
+    if (fValid) {
+        for (size_t i = 0; i < nRecords; i++) {
+            int32_t nPrev = vPrev[i];
+            if (nPrev < -1 || nPrev >= (int32_t)i || !mapBlockIndex.insert(vHashes[i], vIndex[i]).second) {
+                fValid = false;
+                break;
+            }
+            vIndex[i]->pprev = nPrev == -1 ? nullptr : vIndex[nPrev];
+        }
+    }
+    if (!fValid) {
+        mapBlockIndex.clear();
+        return error("%s : corrupt block index snapshot", __func__);
+    }
+    LogPrintf("Loaded %u block index entries from the snapshot\n", nRecords);
+    return true;
+}
+} // anon namespace
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -211,59 +564,151 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     ssKeySet << make_pair(DB_BLOCK_INDEX, uint256());
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
+    // Load mapBlockIndex. Records are copied out of the database in batches;
+    // decoding them and hashing the headers is spread over several threads,
+    // linking them into mapBlockIndex is done in order.
+    std::vector<std::string> vValues;
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<uint256> vHashes;
+    bool fDone = false;
+    while (!fDone) {
+        vValues.clear();
+        while (vValues.size() < BLOCK_INDEX_LOAD_BATCH) {
+            boost::this_thread::interruption_point();
+            if (!pcursor->Valid()) {
+                fDone = true;
+                break;
+            }
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == DB_BLOCK_INDEX) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+            if (slKey.size() == 0 || slKey[0] != DB_BLOCK_INDEX) {
+                fDone = true; // finished loading block index
+                break;
+            }
+            leveldb::Slice slValue = pcursor->value();
+            vValues.push_back(std::string(slValue.data(), slValue.size()));
+            pcursor->Next();
+        }
+
+        vDiskIndex.assign(vValues.size(), CDiskBlockIndex());
+        vHashes.assign(vValues.size(), uint256());
+        std::atomic<bool> fFailed(false);
+        ParallelForRanges(vValues.size(), 256, [&](size_t nBegin, size_t nEnd) {
+            for (size_t i = nBegin; i < nEnd && !fFailed; i++) {
+                try {
+                    CDataStream ssValue(vValues[i].data(), vValues[i].data() + vValues[i].size(), SER_DISK, CLIENT_VERSION);
+                    ssValue >> vDiskIndex[i];
+                    vHashes[i] = vDiskIndex[i].GetBlockHash();
+                    if (vDiskIndex[i].nHeight <= Params().LAST_POW_BLOCK() && !CheckProofOfWork(vHashes[i], vDiskIndex[i].nBits)) {
+                        error("LoadBlockIndex() : CheckProofOfWork failed: %s", vDiskIndex[i].ToString());
+                        fFailed = true;
+                    }
+                } catch (const std::exception& e) {
+                    error("%s : Deserialize or I/O error - %s", __func__, e.what());
+                    fFailed = true;
                 }
+            }
+        });
+        if (fFailed)
+            return false;
+
+        for (size_t i = 0; i < vDiskIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(vHashes[i]);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+        }
+    }
 
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+    return true;
+}
+
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const uint256& hashBestChain)
+{
+    // Sorted by height, so that parents come before their children
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(mapBlockIndex.size());
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        vIndex.push_back(item.second);
+    if (vIndex.empty())
+        return true;
+    std::sort(vIndex.begin(), vIndex.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+    std::map<const CBlockIndex*, int32_t> mapPos;
+    for (size_t i = 0; i < vIndex.size(); i++)
+        mapPos[vIndex[i]] = i;
+
+    int64_t nStart = GetTimeMillis();
+    uint256 id = GetRandHash();
+    boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".new";
+    CAutoFile fileout(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : failed to open %s", __func__, pathTmp.string());
+    try {
+        fileout.write((const char*)Params().MessageStart(), MESSAGE_START_SIZE);
+        fileout << BLOCK_INDEX_SNAPSHOT_VERSION << id << hashBestChain << (uint64_t)vIndex.size();
+        std::vector<uint256> vChunkHashes;
+        CDataStream ssChunk(SER_DISK, CLIENT_VERSION);
+        for (size_t i = 0; i < vIndex.size(); i++) {
+            const CBlockIndex* pindex = vIndex[i];
+            int32_t nPrev = pindex->pprev ? mapPos[pindex->pprev] : -1;
+            WriteSnapshotRecord(ssChunk, *pindex, nPrev);
+            if ((i + 1) % BLOCK_INDEX_SNAPSHOT_CHUNK == 0 || i + 1 == vIndex.size()) {
+                vChunkHashes.push_back(Hash(ssChunk.begin(), ssChunk.end()));
+                fileout.write(&ssChunk[0], ssChunk.size());
+                ssChunk.clear();
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+        for (const uint256& hash : vChunkHashes)
+            fileout << hash;
+        FileCommit(fileout.Get());
+    } catch (const std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
     }
+    fileout.fclose();
+    if (!RenameOver(pathTmp, path))
+        return error("%s : failed to rename %s", __func__, pathTmp.string());
 
+    // Tie the snapshot to this database. Loading it removes the tie, so a
+    // database changed after the next start is never paired with this file.
+    if (!Write(DB_BLOCK_INDEX_SNAPSHOT, id, true))
+        return false;
+    LogPrintf("Wrote block index snapshot of %u entries (%dms)\n", vIndex.size(), GetTimeMillis() - nStart);
     return true;
 }
+
+bool CBlockTreeDB::LoadBlockIndexSnapshot(const uint256& hashBestChain)
+{
+    boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    uint256 id;
+    bool fTied = Read(DB_BLOCK_INDEX_SNAPSHOT, id);
+    if (fTied && !Erase(DB_BLOCK_INDEX_SNAPSHOT, true))
+        return false;
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(path, ec))
+        return false;
+    bool fLoaded = fTied && mapBlockIndex.empty() && ReadBlockIndexSnapshot(path, id, hashBestChain);
+    boost::filesystem::remove(path, ec);
+    return fLoaded;
+}
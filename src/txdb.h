@@ -7,8 +7,11 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "coins.h"
 #include "leveldbwrapper.h"
+#include "spentindex.h"
+#include "timestampindex.h"
 
 #include <map>
 #include <string>
@@ -33,14 +36,24 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CLevelDBWrapper db;
 
+    //! Statistics of the stored coins, valid once fTallyLoaded is set
+    mutable CCoinsTally tallyTotal;
+    mutable bool fTallyLoaded;
+
+    //! Compute the statistics of the stored coins by scanning all of them
+    bool ComputeTally(CCoinsTally& tally) const;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
-    bool GetStats(CCoinsStats& stats) const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsTally& tally);
+    bool GetTally(CCoinsTally& tally) const;
+
+    //! Load the stored statistics; chainstates written before they existed get a one-time full scan
+    bool LoadTally() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -61,9 +74,28 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+    bool WriteTimestampIndex(const CTimestampIndexKey& timestampIndex);
+    bool EraseTimestampIndex(const CTimestampIndexKey& timestampIndex);
+    bool ReadTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256>& vHashes);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
+    //! Record how far an interrupted VerifyDB got, so that the next one at the same tip can skip those blocks
+    bool WriteVerifyProgress(const uint256& hashTip, int nCheckLevel, int nHeight);
+    bool ReadVerifyProgress(uint256& hashTip, int& nCheckLevel, int& nHeight);
+    bool EraseVerifyProgress();
     bool LoadBlockIndexGuts();
+
+    //! Write a flat copy of mapBlockIndex, tied to this database, for LoadBlockIndexSnapshot on the next start
+    bool WriteBlockIndexSnapshot(const uint256& hashBestChain);
+    //! Load mapBlockIndex from the snapshot if it was written by the last shutdown at the same chain tip
+    bool LoadBlockIndexSnapshot(const uint256& hashBestChain);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -22,11 +22,15 @@ CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0),
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
 {
-    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    nTxSize = ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
 
-    nModSize = tx.CalculateModifiedSize(nTxSize);
+    nModSize = tx->CalculateModifiedSize(nTxSize);
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : CTxMemPoolEntry(MakeTransactionRef(_tx), _nFee, _nTime, _dPriority, _nHeight)
+{
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -37,7 +41,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
 double
 CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    CAmount nValueIn = tx.GetValueOut() + nFee;
+    CAmount nValueIn = tx->GetValueOut() + nFee;
     double deltaPriority = ((double)(currentHeight - nHeight) * nValueIn) / nModSize;
     double dResult = dPriority + deltaPriority;
     return dResult;
@@ -420,6 +424,104 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 }
 
 
+void CTxMemPool::addAddressIndex(const CTxMemPoolEntry& entry, const CCoinsViewCache& view)
+{
+    LOCK(cs);
+    const CTransaction& tx = entry.GetTx();
+    const uint256 txhash = tx.GetHash();
+    std::vector<CMempoolAddressDeltaKey> inserted;
+
+    uint160 hashBytes;
+    int type;
+    for (unsigned int j = 0; j < tx.vin.size(); j++) {
+        const CTxIn& input = tx.vin[j];
+        const CTxOut& prevout = view.GetOutputFor(input);
+        if (!GetAddressIndexKey(prevout.scriptPubKey, hashBytes, type))
+            continue;
+        CMempoolAddressDeltaKey key(type, hashBytes, txhash, j, true);
+        mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), -prevout.nValue, input.prevout.hash, input.prevout.n)));
+        inserted.push_back(key);
+    }
+
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut& out = tx.vout[k];
+        if (!GetAddressIndexKey(out.scriptPubKey, hashBytes, type))
+            continue;
+        CMempoolAddressDeltaKey key(type, hashBytes, txhash, k, false);
+        mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+        inserted.push_back(key);
+    }
+
+    if (!inserted.empty())
+        mapAddressInserted.insert(std::make_pair(txhash, inserted));
+}
+
+bool CTxMemPool::getAddressIndex(const std::vector<std::pair<uint160, int> >& addresses,
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >& results)
+{
+    LOCK(cs);
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta>::const_iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey(it->second, it->first));
+        while (ait != mapAddress.end() && ait->first.addressBytes == it->first && ait->first.type == it->second) {
+            results.push_back(*ait);
+            ait++;
+        }
+    }
+    return true;
+}
+
+void CTxMemPool::removeAddressIndex(const uint256& txhash)
+{
+    std::map<uint256, std::vector<CMempoolAddressDeltaKey> >::iterator it = mapAddressInserted.find(txhash);
+    if (it == mapAddressInserted.end())
+        return;
+    BOOST_FOREACH (const CMempoolAddressDeltaKey& key, it->second)
+        mapAddress.erase(key);
+    mapAddressInserted.erase(it);
+}
+
+void CTxMemPool::addSpentIndex(const CTxMemPoolEntry& entry, const CCoinsViewCache& view)
+{
+    LOCK(cs);
+    const CTransaction& tx = entry.GetTx();
+    const uint256 txhash = tx.GetHash();
+    std::vector<CSpentIndexKey> inserted;
+
+    for (unsigned int j = 0; j < tx.vin.size(); j++) {
+        const CTxIn& input = tx.vin[j];
+        const CTxOut& prevout = view.GetOutputFor(input);
+        uint160 hashBytes;
+        int type = ADDRESS_TYPE_UNKNOWN;
+        GetAddressIndexKey(prevout.scriptPubKey, hashBytes, type);
+        CSpentIndexKey key(input.prevout.hash, input.prevout.n);
+        mapSpent.insert(std::make_pair(key, CSpentIndexValue(txhash, j, -1, prevout.nValue, type, hashBytes)));
+        inserted.push_back(key);
+    }
+
+    if (!inserted.empty())
+        mapSpentInserted.insert(std::make_pair(txhash, inserted));
+}
+
+bool CTxMemPool::getSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    LOCK(cs);
+    std::map<CSpentIndexKey, CSpentIndexValue>::const_iterator it = mapSpent.find(key);
+    if (it == mapSpent.end())
+        return false;
+    value = it->second;
+    return true;
+}
+
+void CTxMemPool::removeSpentIndex(const uint256& txhash)
+{
+    std::map<uint256, std::vector<CSpentIndexKey> >::iterator it = mapSpentInserted.find(txhash);
+    if (it == mapSpentInserted.end())
+        return;
+    BOOST_FOREACH (const CSpentIndexKey& key, it->second)
+        mapSpent.erase(key);
+    mapSpentInserted.erase(it);
+}
+
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
@@ -456,6 +558,9 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
             BOOST_FOREACH (const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
 
+            removeAddressIndex(hash);
+            removeSpentIndex(hash);
+
             removed.push_back(tx);
             totalTxSize -= mapTx[hash].GetTxSize();
             mapTx.erase(hash);
@@ -508,17 +613,18 @@ void CTxMemPool::removeConflicts(const CTransaction& tx, std::list<CTransaction>
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
  */
-void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts)
+void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts)
 {
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
-    BOOST_FOREACH (const CTransaction& tx, vtx) {
-        uint256 hash = tx.GetHash();
+    BOOST_FOREACH (const CTransactionRef& tx, vtx) {
+        uint256 hash = tx->GetHash();
         if (mapTx.count(hash))
             entries.push_back(mapTx[hash]);
     }
     minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
-    BOOST_FOREACH (const CTransaction& tx, vtx) {
+    BOOST_FOREACH (const CTransactionRef& ptx, vtx) {
+        const CTransaction& tx = *ptx;
         std::list<CTransaction> dummy;
         remove(tx, dummy, false);
         removeConflicts(tx, conflicts);
@@ -532,6 +638,10 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapAddress.clear();
+    mapAddressInserted.clear();
+    mapSpent.clear();
+    mapSpentInserted.clear();
     totalTxSize = 0;
     ++nTransactionsUpdated;
 }
@@ -629,6 +739,15 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
+CTransactionRef CTxMemPool::get(const uint256& hash) const
+{
+    LOCK(cs);
+    map<uint256, CTxMemPoolEntry>::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end())
+        return CTransactionRef();
+    return i->second.GetSharedTx();
+}
+
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
     LOCK(cs);
@@ -707,9 +826,9 @@ bool CCoinsViewMemPool::GetCoins(const uint256& txid, CCoins& coins) const
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
-    CTransaction tx;
-    if (mempool.lookup(txid, tx)) {
-        coins = CCoins(tx, MEMPOOL_HEIGHT);
+    CTransactionRef ptx = mempool.get(txid);
+    if (ptx) {
+        coins = CCoins(*ptx, MEMPOOL_HEIGHT);
         return true;
     }
     return (base->GetCoins(txid, coins) && !coins.IsPruned());
@@ -7,8 +7,29 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+#include "util.h"
+
+#include <deque>
+#include <functional>
+
+#include <boost/thread.hpp>
+
 static CMainSignals g_signals;
 
+static boost::mutex csQueue;
+static boost::condition_variable condQueue;
+static boost::condition_variable condDelivered;
+static std::deque<std::function<void ()> > dequeCallbacks;
+//! Notifications queued and delivered since startup
+static uint64_t nQueued = 0;
+static uint64_t nDelivered = 0;
+static bool fQueueRunning = false;
+static bool fQueueStop = false;
+static boost::thread threadQueue;
+//! Id of the delivering thread, guarded by csQueue unlike threadQueue
+static boost::thread::id idQueueThread;
+
 CMainSignals& GetMainSignals()
 {
     return g_signals;
@@ -56,6 +77,125 @@ void UnregisterAllValidationInterfaces() {
 // XX42    g_signals.EraseTransaction.disconnect_all_slots();
 }
 
-void SyncWithWallets(const CTransaction &tx, const CBlock *pblock = nullptr) {
-    g_signals.SyncTransaction(tx, pblock);
+static void ThreadValidationQueue()
+{
+    RenameThread("bitgreen-notify");
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    while (true) {
+        while (!fQueueStop && dequeCallbacks.empty())
+            condQueue.wait(lock);
+        if (dequeCallbacks.empty()) {
+            // Whatever comes after this is delivered right away
+            fQueueRunning = false;
+            idQueueThread = boost::thread::id();
+            condDelivered.notify_all();
+            return;
+        }
+        std::function<void ()> callback;
+        callback.swap(dequeCallbacks.front());
+        dequeCallbacks.pop_front();
+        lock.unlock();
+
+        try {
+            callback();
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, "ThreadValidationQueue()");
+        } catch (...) {
+            PrintExceptionContinue(nullptr, "ThreadValidationQueue()");
+        }
+
+        lock.lock();
+        nDelivered++;
+        condDelivered.notify_all();
+    }
+}
+
+//! Requires csQueue
+static bool IsQueueThread()
+{
+    return boost::this_thread::get_id() == idQueueThread;
+}
+
+static void Enqueue(std::function<void ()>&& callback)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csQueue);
+        if (fQueueRunning) {
+            dequeCallbacks.push_back(std::move(callback));
+            nQueued++;
+            condQueue.notify_one();
+            return;
+        }
+    }
+    callback();
+}
+
+void StartValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    if (fQueueRunning)
+        return;
+    fQueueStop = false;
+    fQueueRunning = true;
+    threadQueue = boost::thread(&ThreadValidationQueue);
+    idQueueThread = threadQueue.get_id();
+}
+
+void StopValidationInterfaceQueue()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csQueue);
+        if (!fQueueRunning)
+            return;
+        fQueueStop = true;
+        condQueue.notify_one();
+    }
+    threadQueue.join();
+}
+
+void SyncWithValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    if (!fQueueRunning || IsQueueThread())
+        return;
+    uint64_t nTarget = nQueued;
+    while (fQueueRunning && nDelivered < nTarget)
+        condDelivered.wait(lock);
+}
+
+void LimitValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    if (!fQueueRunning || IsQueueThread())
+        return;
+    while (fQueueRunning && dequeCallbacks.size() > MAX_VALIDATION_QUEUE_SIZE)
+        condDelivered.wait(lock);
+}
+
+void SyncWithWallets(const CTransactionRef& ptx)
+{
+    Enqueue([ptx]() { g_signals.SyncTransaction(*ptx, nullptr); });
+}
+
+void SyncBlockWithWallets(const std::shared_ptr<const CBlock>& pblock)
+{
+    Enqueue([pblock]() {
+        for (const CTransactionRef& ptx : pblock->vtx)
+            g_signals.SyncTransaction(*ptx, pblock.get());
+    });
+}
+
+void NotifyUpdatedBlockTip(const CBlockIndex* pindex)
+{
+    Enqueue([pindex]() { g_signals.UpdatedBlockTip(pindex); });
+}
+
+void NotifyUpdatedTransaction(const uint256& hash)
+{
+    Enqueue([hash]() { g_signals.UpdatedTransaction(hash); });
+}
+
+void NotifySetBestChain(const CBlockLocator& locator)
+{
+    Enqueue([locator]() { g_signals.SetBestChain(locator); });
 }
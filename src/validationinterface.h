@@ -8,6 +8,8 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include <memory>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -16,6 +18,7 @@ struct CBlockLocator;
 class CBlockIndex;
 class CReserveScript;
 class CTransaction;
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
 class CValidationInterface;
 class CValidationState;
 class uint256;
@@ -28,8 +31,37 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+
+//! Maximum number of notifications waiting before LimitValidationInterfaceQueue() blocks
+static const unsigned int MAX_VALIDATION_QUEUE_SIZE = 100;
+
+/**
+ * Transaction, tip and best chain notifications are delivered in order on a
+ * thread of their own, so that listeners such as the wallet do not hold up
+ * block connection. Until the thread is started, and after it is stopped,
+ * they are delivered right away on the calling thread.
+ *
+ * The waiting functions must not be called with cs_main or a wallet lock
+ * held, the listeners take those locks.
+ */
+void StartValidationInterfaceQueue();
+/** Deliver the notifications still queued and stop the thread */
+void StopValidationInterfaceQueue();
+/** Wait until the notifications queued so far have been delivered */
+void SyncWithValidationInterfaceQueue();
+/** Wait while more than MAX_VALIDATION_QUEUE_SIZE notifications are queued */
+void LimitValidationInterfaceQueue();
+
 /** Push an updated transaction to all registered wallets */
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock);
+void SyncWithWallets(const CTransactionRef& ptx);
+/** Push the transactions of a newly connected block to all registered wallets */
+void SyncBlockWithWallets(const std::shared_ptr<const CBlock>& pblock);
+/** Queue UpdatedBlockTip for all registered listeners */
+void NotifyUpdatedBlockTip(const CBlockIndex* pindex);
+/** Queue UpdatedTransaction for all registered listeners */
+void NotifyUpdatedTransaction(const uint256& hash);
+/** Queue SetBestChain for all registered listeners */
+void NotifySetBestChain(const CBlockLocator& locator);
 
 class CValidationInterface {
 protected:
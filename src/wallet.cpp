@@ -9,8 +9,11 @@
 #include "wallet.h"
 
 #include "base58.h"
+#include "blockstore.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "crypto/common.h"
+#include "init.h"
 #include "kernel.h"
 #include "main.h"
 #include "masternode-budget.h"
@@ -27,6 +30,7 @@
 #include "utilmoneystr.h"
 
 #include <assert.h>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -59,14 +63,6 @@ int64_t nStartupTime = GetAdjustedTime();
  * @{
  */
 
-struct CompareValueOnly {
-    bool operator()(const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t1,
-        const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->vout[i].nValue));
@@ -103,8 +99,11 @@ CPubKey CWallet::GenerateNewKey()
     if (!nTimeFirstKey || nCreationTime < nTimeFirstKey)
         nTimeFirstKey = nCreationTime;
 
+    // Nothing can have paid to a key made just now, the unspent output index stays valid
+    bool fIndexStale = fUnspentIndexStale;
     if (!AddKeyPubKey(secret, pubkey))
         throw std::runtime_error("CWallet::GenerateNewKey() : AddKey failed");
+    fUnspentIndexStale = fIndexStale;
     return pubkey;
 }
 
@@ -113,6 +112,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    fUnspentIndexStale = true;
 
     // check if we need to remove from watch-only
     CScript script;
@@ -166,6 +166,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    fUnspentIndexStale = true;
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -190,6 +191,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    fUnspentIndexStale = true;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -220,6 +222,7 @@ bool CWallet::AddMultiSig(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddMultiSig(dest))
         return false;
+    fUnspentIndexStale = true;
     nTimeFirstKey = 1; // No birthday information
     NotifyMultiSigChanged(true);
     if (!fFileBacked)
@@ -462,6 +465,72 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+/**
+ * Outpoint is spent by a wallet transaction in the
+ * active chain, so no reorganization short of
+ * disconnecting that transaction can make it unspent
+ */
+bool CWallet::IsSpentInMainChain(const COutPoint& outpoint) const
+{
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.IsInMainChain())
+            return true;
+    }
+    return false;
+}
+
+void CWallet::UpdateUnspent(const COutPoint& outpoint, const CTxOut& txout) const
+{
+    if (IsMine(txout) != ISMINE_NO && !IsSpentInMainChain(outpoint))
+        setWalletUnspent.insert(outpoint);
+    else
+        setWalletUnspent.erase(outpoint);
+}
+
+void CWallet::UpdateUnspentIndex() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (fUnspentIndexStale) {
+        fUnspentIndexStale = false;
+        setWalletUnspent.clear();
+        setUnspentDirty.clear();
+        for (const PAIRTYPE(const uint256, CWalletTx) & item : mapWallet) {
+            for (unsigned int i = 0; i < item.second.vout.size(); i++)
+                UpdateUnspent(COutPoint(item.first, i), item.second.vout[i]);
+        }
+        return;
+    }
+
+    // Transactions added or updated since the last call: their own outputs,
+    // and the outputs they spend, which a change of their block affects
+    for (const uint256& hash : setUnspentDirty) {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = mi->second;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++)
+            UpdateUnspent(COutPoint(hash, i), wtx.vout[i]);
+        if (wtx.IsCoinBase())
+            continue;
+        for (const CTxIn& txin : wtx.vin) {
+            std::map<uint256, CWalletTx>::const_iterator mprev = mapWallet.find(txin.prevout.hash);
+            if (mprev != mapWallet.end() && txin.prevout.n < mprev->second.vout.size())
+                UpdateUnspent(txin.prevout, mprev->second.vout[txin.prevout.n]);
+        }
+    }
+    setUnspentDirty.clear();
+}
+
+std::set<COutPoint> CWallet::GetUnspentIndex() const
+{
+    UpdateUnspentIndex();
+    return setWalletUnspent;
+}
+
 bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -646,6 +715,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        fUnspentIndexStale = true;
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -653,6 +723,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         bool fInsertedNew = ret.second;
+        setUnspentDirty.insert(hash);
         if (fInsertedNew) {
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
@@ -728,6 +799,13 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
+    {
+        // Most transactions are not ours, sort them out without holding up validation
+        LOCK(cs_wallet);
+        if (!mapWallet.count(tx.GetHash()) && !IsMine(tx) && !IsFromMe(tx))
+            return;
+    }
+
     LOCK2(cs_main, cs_wallet);
     if (!AddToWalletIfInvolvingMe(tx, pblock, true))
         return; // Not one of ours
@@ -747,8 +825,10 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            fUnspentIndexStale = true;
+        }
     }
     return;
 }
@@ -1172,46 +1252,241 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+namespace
+{
+/** Hashes a key or script id, which is a hash already */
+struct CScanIDHasher {
+    size_t operator()(const uint160& id) const { return ReadLE64(id.begin()); }
+};
+
+/**
+ * What a wallet rescan looks for in transaction outputs, copied from the key
+ * store so that blocks can be filtered on the reader threads without taking
+ * cs_wallet. Every output IsMine() accepts matches, but not the other way
+ * round: a multisig output already matches if one of its keys is ours.
+ */
+class CWalletScanFilter
+{
+private:
+    std::unordered_set<uint160, CScanIDHasher> setKeyIDs;
+    std::unordered_set<uint160, CScanIDHasher> setScriptIDs;
+    std::set<CScript> setScripts; //!< watch-only and multisig scripts
+
+public:
+    explicit CWalletScanFilter(const CWallet& wallet)
+    {
+        std::set<CKeyID> setKeys;
+        wallet.GetKeys(setKeys);
+        setKeyIDs.insert(setKeys.begin(), setKeys.end());
+        std::set<CScriptID> setRedeemScripts;
+        wallet.GetCScripts(setRedeemScripts);
+        setScriptIDs.insert(setRedeemScripts.begin(), setRedeemScripts.end());
+        WatchOnlySet setWatchOnly;
+        wallet.GetWatchOnly(setWatchOnly);
+        MultiSigScriptSet setMultiSig;
+        wallet.GetMultiSig(setMultiSig);
+        setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+        setScripts.insert(setMultiSig.begin(), setMultiSig.end());
+    }
+
+    bool Matches(const CScript& scriptPubKey) const
+    {
+        if (setScripts.count(scriptPubKey))
+            return true;
+        uint160 id;
+        if (scriptPubKey.IsPayToScriptHash()) {
+            memcpy(id.begin(), &scriptPubKey[2], 20);
+            return setScriptIDs.count(id) > 0;
+        }
+        // Pay to pubkey hash, pay to pubkey and multisig: a key hash or a
+        // public key of ours is pushed
+        CScript::const_iterator pc = scriptPubKey.begin();
+        opcodetype opcode;
+        std::vector<unsigned char> vch;
+        while (scriptPubKey.GetOp(pc, opcode, vch)) {
+            if (vch.size() == 20) {
+                memcpy(id.begin(), &vch[0], 20);
+                if (setKeyIDs.count(id))
+                    return true;
+            } else if (vch.size() >= 33 && vch.size() <= 65 && setKeyIDs.count(Hash160(vch))) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/** A block read ahead by a wallet rescan */
+struct CWalletScanBlock {
+    CBlock block;
+    std::vector<bool> vMatch; //!< per transaction: one of its outputs passed the filter
+};
+
+bool ReadWalletScanBlock(const CWalletScanFilter& filter, const CBlockIndex* pindex, CWalletScanBlock& item, std::string& strError)
+{
+    if (!ReadBlockFromDisk(item.block, pindex)) {
+        strError = "ReadBlockFromDisk failed";
+        return false;
+    }
+    item.vMatch.assign(item.block.vtx.size(), false);
+    for (size_t i = 0; i < item.block.vtx.size(); i++) {
+        for (const CTxOut& txout : item.block.vtx[i]->vout) {
+            if (filter.Matches(txout.scriptPubKey)) {
+                item.vMatch[i] = true;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/** Marks a wallet as scanning for as long as it exists */
+class CWalletScanReserver
+{
+private:
+    std::atomic<bool>& fScanning;
+    bool fReserved;
+
+public:
+    explicit CWalletScanReserver(std::atomic<bool>& fScanningIn) : fScanning(fScanningIn)
+    {
+        bool fExpected = false;
+        fReserved = fScanning.compare_exchange_strong(fExpected, true);
+    }
+    ~CWalletScanReserver()
+    {
+        if (fReserved)
+            fScanning = false;
+    }
+    bool IsReserved() const { return fReserved; }
+};
+} // anon namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and filtered against the wallet's keys and scripts on
+ * worker threads; only the transactions that pass the filter, or spend one
+ * that did, are handed to AddToWalletIfInvolvingMe(), taking cs_main and
+ * cs_wallet for one block at a time. The scan stops early on AbortRescan()
+ * or a shutdown. Returns -1 if another scan is running.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
+    CWalletScanReserver reserver(fScanningWallet);
+    if (!reserver.IsReserved()) {
+        LogPrintf("%s : a rescan is already in progress\n", __func__);
+        return -1;
+    }
+    fAbortRescan = false;
+    nScanStartTime = GetTimeMillis();
+    dScanProgress = 0;
+
     int ret = 0;
     int64_t nNow = GetTime();
 
-    CBlockIndex* pindex = pindexStart;
+    std::vector<CBlockIndex*> vBlocks;
+    std::unordered_set<uint256, CCoinsKeyHasher> setTxids; //!< transactions that are, or may be, in the wallet
+    double dProgressStart, dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
+        CBlockIndex* pindex = pindexStart;
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
+        for (; pindex; pindex = chainActive.Next(pindex))
+            vBlocks.push_back(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        for (const PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
+            setTxids.insert(item.first);
+        dProgressStart = vBlocks.empty() ? 0.0 : Checkpoints::GuessVerificationProgress(vBlocks.front(), false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+    const CWalletScanFilter filter(*this);
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    CBlockIndex* pindexLast = nullptr;
+
+    // Blocks with candidate transactions are added to the wallet a few at a
+    // time, with their database writes in one batch
+    std::vector<std::pair<CWalletScanBlock, std::vector<size_t> > > vPending;
+    auto AddPending = [&]() {
+        if (vPending.empty())
+            return;
+        LOCK2(cs_main, cs_wallet);
+        CDBBatch batch(strWalletFile);
+        for (const std::pair<CWalletScanBlock, std::vector<size_t> >& pending : vPending) {
+            for (size_t i : pending.second) {
+                if (AddToWalletIfInvolvingMe(*pending.first.block.vtx[i], &pending.first.block, fUpdate))
                     ret++;
             }
-            pindex = chainActive.Next(pindex);
+        }
+        vPending.clear();
+    };
+    {
+        CBlockReadAhead<CWalletScanBlock> reader(vBlocks, boost::bind(ReadWalletScanBlock, boost::cref(filter), _1, _2, _3), nScriptCheckThreads, MAX_RESCAN_READ_AHEAD);
+        for (CBlockIndex* pindex : vBlocks) {
+            if (fAbortRescan || ShutdownRequested()) {
+                LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                break;
+            }
+            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+                dScanProgress = std::max(0.0, std::min(1.0, (Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart)));
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(dScanProgress * 100))));
+            }
+
+            CWalletScanBlock item;
+            std::string strError;
+            if (!reader.Next(item, strError))
+                LogPrintf("%s : %s at %d, hash=%s\n", __func__, strError, pindex->nHeight, pindex->GetBlockHash().ToString());
+
+            // A transaction can only be ours if an output passed the filter or
+            // it spends from one that may be ours
+            std::vector<size_t> vCandidates;
+            for (size_t i = 0; i < item.block.vtx.size(); i++) {
+                const CTransaction& tx = *item.block.vtx[i];
+                bool fCandidate = item.vMatch[i] || setTxids.count(tx.GetHash());
+                for (unsigned int j = 0; j < tx.vin.size() && !fCandidate; j++)
+                    fCandidate = setTxids.count(tx.vin[j].prevout.hash) > 0;
+                if (fCandidate) {
+                    setTxids.insert(tx.GetHash());
+                    vCandidates.push_back(i);
+                }
+            }
+            if (!vCandidates.empty()) {
+                vPending.emplace_back(std::move(item), std::move(vCandidates));
+                if (vPending.size() >= MAX_RESCAN_BATCH_BLOCKS)
+                    AddPending();
+            }
+            pindexLast = pindex;
+
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+    AddPending();
+
+    // Blocks connected meanwhile went through SyncTransaction(), but may spend
+    // transactions the scan only found afterwards
+    if (!vBlocks.empty() && pindexLast == vBlocks.back()) {
+        LOCK2(cs_main, cs_wallet);
+        CDBBatch batch(strWalletFile);
+        for (CBlockIndex* pindex = chainActive.Next(chainActive.FindFork(pindexLast)); pindex; pindex = chainActive.Next(pindex)) {
+            CBlock block;
+            ReadBlockFromDisk(block, pindex);
+            BOOST_FOREACH (const CTransactionRef& tx, block.vtx) {
+                if (AddToWalletIfInvolvingMe(*tx, &block, fUpdate))
+                    ret++;
+            }
+        }
+    }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -1467,9 +1742,18 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        UpdateUnspentIndex();
+        std::set<COutPoint>::const_iterator itNext = setWalletUnspent.begin();
+        while (itNext != setWalletUnspent.end()) {
+            // The outputs of one transaction are next to each other in the index
+            std::set<COutPoint>::const_iterator itBegin = itNext;
+            const uint256& wtxid = itBegin->hash;
+            while (itNext != setWalletUnspent.end() && itNext->hash == wtxid)
+                ++itNext;
+            std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(wtxid);
+            if (mi == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &mi->second;
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1490,7 +1774,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            for (std::set<COutPoint>::const_iterator it = itBegin; it != itNext; ++it) {
+                unsigned int i = it->n;
                 bool found = false;
                 if (nCoinType == ONLY_NOT10000IFMN) {
                     found = !(fMasterNode && pcoin->vout[i].nValue == MASTERNODE_COLLATERAL * COIN);
@@ -1511,11 +1796,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
                     continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
                     continue;
                 if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
                     continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                     continue;
 
                 bool fIsSpendable = false;
@@ -1549,45 +1834,6 @@ map<CBitcoinAddress, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fCo
     return mapCoins;
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
-{
-    vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    seed_insecure_rand();
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
-        vfIncluded.assign(vValue.size(), false);
-        CAmount nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
-            for (unsigned int i = 0; i < vValue.size(); i++) {
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng is fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand() & 1 : !vfIncluded[i]) {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue) {
-                        fReachedTarget = true;
-                        if (nTotal < nBest) {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
-}
-
 bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const
 {
     LOCK(cs_main);
@@ -1648,108 +1894,206 @@ bool CWallet::MintableCoins()
     return false;
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+namespace
 {
-    setCoinsRet.clear();
-    nValueRet = 0;
-
-    // List of values less than target
-    pair<CAmount, pair<const CWalletTx*, unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-    coinLowestLarger.second.first = nullptr;
-    vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue;
-    CAmount nTotalLower = 0;
-
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
-    // try to find nondenom first to prevent unneeded spending of mixed coins
-    for (unsigned int tryDenom = 0; tryDenom < 2; tryDenom++) {
-        if (fDebug) LogPrint("selectcoins", "tryDenom: %d\n", tryDenom);
-        vValue.clear();
-        nTotalLower = 0;
-        BOOST_FOREACH (const COutput& output, vCoins) {
-            if (!output.fSpendable)
-                continue;
+/** A spendable output as coin selection sees it */
+struct CSelectionCoin {
+    CAmount nValue;
+    int nDepth;
+    bool fFromMe;
+    std::pair<const CWalletTx*, unsigned int> coin;
+};
 
-            const CWalletTx* pcoin = output.tx;
+bool CompareSelectionCoin(const CSelectionCoin& a, const CSelectionCoin& b)
+{
+    return a.nValue > b.nValue;
+}
 
-            //            if (fDebug) LogPrint("selectcoins", "value %s confirms %d\n", FormatMoney(pcoin->vout[output.i].nValue), output.nDepth);
-            if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
-                continue;
+/**
+ * Sort the spendable outputs by descending value for SelectCoinsFromPool().
+ * Outputs of the same value are in random order, so which of them gets
+ * spent doesn't reveal anything.
+ */
+void MakeSelectionPool(const std::vector<COutput>& vCoins, std::vector<CSelectionCoin>& vPool)
+{
+    vPool.clear();
+    vPool.reserve(vCoins.size());
+    for (const COutput& output : vCoins) {
+        if (!output.fSpendable)
+            continue;
+        CSelectionCoin coin;
+        coin.nValue = output.tx->vout[output.i].nValue;
+        coin.nDepth = output.nDepth;
+        coin.fFromMe = output.tx->IsFromMe(ISMINE_ALL);
+        coin.coin = std::make_pair(output.tx, (unsigned int)output.i);
+        vPool.push_back(coin);
+    }
+    random_shuffle(vPool.begin(), vPool.end(), GetRandInt);
+    std::stable_sort(vPool.begin(), vPool.end(), CompareSelectionCoin);
+}
 
-            int i = output.i;
-            CAmount n = pcoin->vout[i].nValue;
+/**
+ * Change below the dust threshold would be added to the fee by
+ * CreateTransaction(), so selections that exceed the target by less than
+ * this don't need a change output (the threshold of CTxOut::IsDust() for a
+ * pay to pubkey hash output).
+ */
+CAmount GetCostOfChange()
+{
+    CTxOut txout(0, CScript() << OP_DUP << OP_HASH160 << ToByteVector(CKeyID()) << OP_EQUALVERIFY << OP_CHECKSIG);
+    return 3 * ::minRelayTxFee.GetFee(txout.GetSerializeSize(SER_DISK, 0) + 148u);
+}
 
-            pair<CAmount, pair<const CWalletTx*, unsigned int> > coin = make_pair(n, make_pair(pcoin, i));
+/**
+ * Depth-first branch and bound over coins sorted by descending value, for the
+ * subset with the smallest sum of at least nTarget. Stops at the first subset
+ * that exceeds nTarget by no more than nCostOfChange, or after
+ * MAX_COIN_SELECTION_TRIES steps with the best subset found so far. Returns
+ * that sum, or -1 if no subset reaches nTarget.
+ */
+CAmount SelectBranchAndBound(const std::vector<const CSelectionCoin*>& vValue, CAmount nTotal, CAmount nTarget, CAmount nCostOfChange, std::vector<char>& vfBest, unsigned int& nTries)
+{
+    std::vector<char> vfSelected(vValue.size(), false);
+    CAmount nSum = 0;
+    CAmount nRemaining = nTotal; //!< sum of the coins from i on
+    CAmount nBest = std::numeric_limits<CAmount>::max();
+    size_t i = 0;
+    for (nTries = 0; nTries < MAX_COIN_SELECTION_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nSum + nRemaining < nTarget || nSum >= nBest) {
+            fBacktrack = true;
+        } else if (nSum >= nTarget) {
+            nBest = nSum;
+            vfBest = vfSelected;
+            if (nSum - nTarget <= nCostOfChange)
+                break;
+            fBacktrack = true;
+        }
 
-            if (n == nTargetValue) {
-                setCoinsRet.insert(coin.second);
-                nValueRet += coin.first;
-                return true;
-            } else if (n < nTargetValue + CENT) {
-                vValue.push_back(coin);
-                nTotalLower += n;
-            } else if (n < coinLowestLarger.first) {
-                coinLowestLarger = coin;
+        if (fBacktrack) {
+            // Exclude the last included coin and go on from there
+            while (i > 0 && !vfSelected[i - 1]) {
+                --i;
+                nRemaining += vValue[i]->nValue;
+            }
+            if (i == 0)
+                break;
+            vfSelected[i - 1] = false;
+            nSum -= vValue[i - 1]->nValue;
+        } else {
+            // Include the next coin, unless the previous coin had the same
+            // value and was excluded: that subset has been tried already
+            nRemaining -= vValue[i]->nValue;
+            if (i == 0 || vValue[i]->nValue != vValue[i - 1]->nValue || vfSelected[i - 1]) {
+                vfSelected[i] = true;
+                nSum += vValue[i]->nValue;
             }
+            ++i;
         }
+    }
+    return nBest == std::numeric_limits<CAmount>::max() ? -1 : nBest;
+}
 
-        if (nTotalLower == nTargetValue) {
-            for (unsigned int i = 0; i < vValue.size(); ++i) {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-            }
+/**
+ * Select coins of at least nTargetValue from a pool made by
+ * MakeSelectionPool(), using coins with nConfMine confirmations if they
+ * come from us and nConfTheirs otherwise:
+ *  - a single coin of exactly the target, or all coins below it if that
+ *    is just enough;
+ *  - a changeless subset of the smaller coins (see GetCostOfChange()),
+ *    found by branch and bound;
+ *  - otherwise the best subset it found, or the smallest larger coin if
+ *    that is closer to the target or the subset would leave sub-cent change.
+ */
+bool SelectCoinsFromPool(const std::vector<CSelectionCoin>& vPool, const CAmount& nTargetValue, int nConfMine, int nConfTheirs, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet)
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    // Coins less than the target plus a cent, largest first
+    const CSelectionCoin* pcoinLowestLarger = nullptr;
+    std::vector<const CSelectionCoin*> vValue;
+    CAmount nTotalLower = 0;
+    for (const CSelectionCoin& coin : vPool) {
+        if (coin.nDepth < (coin.fFromMe ? nConfMine : nConfTheirs))
+            continue;
+
+        if (coin.nValue == nTargetValue) {
+            setCoinsRet.insert(coin.coin);
+            nValueRet += coin.nValue;
             return true;
+        } else if (coin.nValue < nTargetValue + CENT) {
+            vValue.push_back(&coin);
+            nTotalLower += coin.nValue;
+        } else {
+            // The pool is sorted, the last of these is the smallest
+            pcoinLowestLarger = &coin;
         }
+    }
 
-        if (nTotalLower < nTargetValue) {
-            if (coinLowestLarger.second.first == nullptr) // there is no input larger than nTargetValue
-            {
-                if (tryDenom == 0)
-                    // we didn't look at denom yet, let's do it
-                    continue;
-                else
-                    // we looked at everything possible and didn't find anything, no luck
-                    return false;
-            }
-            setCoinsRet.insert(coinLowestLarger.second);
-            nValueRet += coinLowestLarger.first;
-            return true;
+    if (nTotalLower == nTargetValue) {
+        for (const CSelectionCoin* pcoin : vValue) {
+            setCoinsRet.insert(pcoin->coin);
+            nValueRet += pcoin->nValue;
         }
+        return true;
+    }
 
-        // nTotalLower > nTargetValue
-        break;
+    if (nTotalLower < nTargetValue) {
+        // there is no input larger than nTargetValue: no luck
+        if (pcoinLowestLarger == nullptr)
+            return false;
+        setCoinsRet.insert(pcoinLowestLarger->coin);
+        nValueRet += pcoinLowestLarger->nValue;
+        return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
-    CAmount nBest;
-
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    unsigned int nTries, nTriesTotal;
+    CAmount nCostOfChange = GetCostOfChange();
+    CAmount nBest = SelectBranchAndBound(vValue, nTotalLower, nTargetValue, nCostOfChange, vfBest, nTries);
+    nTriesTotal = nTries;
+    bool fChangeless = nBest != -1 && nBest - nTargetValue <= nCostOfChange;
+    if (!fChangeless && nTotalLower >= nTargetValue + CENT) {
+        // Rather leave at least a cent of change
+        vector<char> vfBestCent;
+        CAmount nBestCent = SelectBranchAndBound(vValue, nTotalLower, nTargetValue + CENT, nCostOfChange, vfBestCent, nTries);
+        nTriesTotal += nTries;
+        if (nBestCent != -1) {
+            nBest = nBestCent;
+            vfBest.swap(vfBestCent);
+        }
+    }
+    if (nBest == -1 && pcoinLowestLarger == nullptr)
+        return false;
 
-    // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
+    // If we have a bigger coin and (either the search didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger.second.first &&
-        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest)) {
-        setCoinsRet.insert(coinLowestLarger.second);
-        nValueRet += coinLowestLarger.first;
+    if (pcoinLowestLarger && !fChangeless &&
+        (nBest == -1 || nBest < nTargetValue + CENT || pcoinLowestLarger->nValue <= nBest)) {
+        setCoinsRet.insert(pcoinLowestLarger->coin);
+        nValueRet += pcoinLowestLarger->nValue;
+        LogPrint("selectcoins", "SelectCoinsFromPool() : larger coin %s, %u tries\n", FormatMoney(nValueRet), nTriesTotal);
     } else {
-        string s = "CWallet::SelectCoinsMinConf best subset: ";
         for (unsigned int i = 0; i < vValue.size(); i++) {
             if (vfBest[i]) {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-                s += FormatMoney(vValue[i].first) + " ";
+                setCoinsRet.insert(vValue[i]->coin);
+                nValueRet += vValue[i]->nValue;
             }
         }
-        LogPrintf("%s - total %s\n", s, FormatMoney(nBest));
+        LogPrint("selectcoins", "SelectCoinsFromPool() : %s subset of %u coins, total %s, %u tries\n", fChangeless ? "changeless" : "best", setCoinsRet.size(), FormatMoney(nValueRet), nTriesTotal);
     }
 
     return true;
 }
+} // anon namespace
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    vector<CSelectionCoin> vPool;
+    MakeSelectionPool(vCoins, vPool);
+    return SelectCoinsFromPool(vPool, nTargetValue, nConfMine, nConfTheirs, setCoinsRet, nValueRet);
+}
 
 bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType coin_type, bool useIX) const
 {
@@ -1768,9 +2112,18 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
         return (nValueRet >= nTargetValue);
     }
 
-    return (SelectCoinsMinConf(nTargetValue, 1, 6, vCoins, setCoinsRet, nValueRet) ||
-            SelectCoinsMinConf(nTargetValue, 1, 1, vCoins, setCoinsRet, nValueRet) ||
-            (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, setCoinsRet, nValueRet)));
+    // The pool is sorted once for all confirmation targets
+    int64_t nTimeStart = GetTimeMicros();
+    vector<CSelectionCoin> vPool;
+    MakeSelectionPool(vCoins, vPool);
+    bool fSelected = (SelectCoinsFromPool(vPool, nTargetValue, 1, 6, setCoinsRet, nValueRet) ||
+                      SelectCoinsFromPool(vPool, nTargetValue, 1, 1, setCoinsRet, nValueRet) ||
+                      (bSpendZeroConfChange && SelectCoinsFromPool(vPool, nTargetValue, 0, 1, setCoinsRet, nValueRet)));
+    if (fSelected)
+        LogPrint("selectcoins", "SelectCoins() : %s in %u of %u coins for %s, waste %s, %.2fms\n", FormatMoney(nValueRet), setCoinsRet.size(), vPool.size(), FormatMoney(nTargetValue), FormatMoney(nValueRet - nTargetValue), (GetTimeMicros() - nTimeStart) * 0.001);
+    else
+        LogPrint("selectcoins", "SelectCoins() : no selection of %u coins for %s, %.2fms\n", vPool.size(), FormatMoney(nTargetValue), (GetTimeMicros() - nTimeStart) * 0.001);
+    return fSelected;
 }
 
 struct CompareByPriority {
@@ -2019,8 +2372,9 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
 
                 // Sign
                 int nIn = 0;
+                PrecomputedTransactionData txdata(txNew);
                 BOOST_FOREACH (const PAIRTYPE(const CWalletTx*, unsigned int) & coin, setCoins)
-                    if (!SignSignature(*this, *coin.first, txNew, nIn++)) {
+                    if (!SignSignature(*this, *coin.first, txNew, nIn++, SIGHASH_ALL, &txdata)) {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
@@ -2150,7 +2504,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         nTxNewTime = GetAdjustedTime();
 
         //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
+        if (CheckStakeKernelHash(nBits, block, pcoin.first->vout[pcoin.second], prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
             //Double check that this will pass time requirements
             if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
                 LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
@@ -2253,8 +2607,9 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     // Sign
     int nIn = 0;
+    PrecomputedTransactionData txdata(txNew);
     for (const CWalletTx* pcoin : vwtxPrev) {
-        if (!SignSignature(*this, *pcoin, txNew, nIn++))
+        if (!SignSignature(*this, *pcoin, txNew, nIn++, SIGHASH_ALL, &txdata))
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
@@ -2456,6 +2811,7 @@ bool CWallet::NewKeyPool()
 {
     {
         LOCK(cs_wallet);
+        CDBBatch batch(strWalletFile);
         CWalletDB walletdb(strWalletFile);
         BOOST_FOREACH (int64_t nIndex, setKeyPool)
             walletdb.ErasePool(nIndex);
@@ -2483,6 +2839,8 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         if (IsLocked())
             return false;
 
+        // The keys and their pool entries are written in one batch
+        CDBBatch batch(strWalletFile);
         CWalletDB walletdb(strWalletFile);
 
         // Top up key pool
@@ -2589,9 +2947,13 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
     map<CTxDestination, CAmount> balances;
 
     {
-        LOCK(cs_wallet);
-        BOOST_FOREACH (PAIRTYPE(uint256, CWalletTx) walletEntry, mapWallet) {
-            CWalletTx* pcoin = &walletEntry.second;
+        LOCK2(cs_main, cs_wallet);
+        UpdateUnspentIndex();
+        for (const COutPoint& outpoint : setWalletUnspent) {
+            std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
+            if (mi == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &mi->second;
 
             if (!IsFinalTx(*pcoin) || !pcoin->IsTrusted())
                 continue;
@@ -2603,19 +2965,15 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
             if (nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? 0 : 1))
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                CTxDestination addr;
-                if (!IsMine(pcoin->vout[i]))
-                    continue;
-                if (!ExtractDestination(pcoin->vout[i].scriptPubKey, addr))
-                    continue;
-
-                CAmount n = IsSpent(walletEntry.first, i) ? 0 : pcoin->vout[i].nValue;
+            CTxDestination addr;
+            if (!IsMine(pcoin->vout[outpoint.n]))
+                continue;
+            if (!ExtractDestination(pcoin->vout[outpoint.n].scriptPubKey, addr))
+                continue;
+            if (IsSpent(outpoint.hash, outpoint.n))
+                continue;
 
-                if (!balances.count(addr))
-                    balances[addr] = 0;
-                balances[addr] += n;
-            }
+            balances[addr] += pcoin->vout[outpoint.n].nValue;
         }
     }
 
@@ -3213,7 +3571,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock& block)
 
     // Locate the transaction
     for (nIndex = 0; nIndex < (int)block.vtx.size(); nIndex++)
-        if (block.vtx[nIndex] == *(CTransaction*)this)
+        if (*block.vtx[nIndex] == *(CTransaction*)this)
             break;
     if (nIndex == (int)block.vtx.size()) {
         vMerkleBranch.clear();
@@ -3292,7 +3650,7 @@ int CMerkleTx::GetBlocksToMaturity() const
 bool CMerkleTx::AcceptToMemoryPool(bool fLimitFree, bool fRejectInsaneFee, bool ignoreFees)
 {
     CValidationState state;
-    bool fAccepted = ::AcceptToMemoryPool(mempool, state, *this, fLimitFree, nullptr, fRejectInsaneFee, ignoreFees);
+    bool fAccepted = ::AcceptToMemoryPool(mempool, state, MakeTransactionRef(static_cast<const CTransaction&>(*this)), fLimitFree, nullptr, fRejectInsaneFee, ignoreFees);
     if (!fAccepted)
         LogPrintf("%s : %s\n", __func__, state.GetRejectReason());
     return fAccepted;
@@ -26,6 +26,7 @@
 #include "walletdb.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -55,6 +56,12 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! Steps of the branch and bound search of coin selection before it settles for the best selection so far
+static const unsigned int MAX_COIN_SELECTION_TRIES = 100000;
+//! Number of blocks a wallet rescan reads ahead of the one being added to the wallet
+static const unsigned int MAX_RESCAN_READ_AHEAD = 64;
+//! Number of blocks with wallet transactions a rescan adds to the wallet at once
+static const unsigned int MAX_RESCAN_BATCH_BLOCKS = 100;
 
 class CAccountingEntry;
 class CBlockIndex;
@@ -163,6 +170,28 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs of wallet transactions that are ours and not spent by a wallet
+     * transaction in the active chain, so that the coin lists don't have to
+     * go through all of mapWallet. Unconfirmed spends are left to IsSpent().
+     * AddToWallet() only records the txid in setUnspentDirty; its outputs and
+     * the outputs it spends are brought up to date by UpdateUnspentIndex(),
+     * which needs cs_main. New keys and scripts can make outputs of any wallet
+     * transaction ours, so they have the whole index rebuilt.
+     */
+    mutable std::set<COutPoint> setWalletUnspent;
+    mutable std::set<uint256> setUnspentDirty;
+    mutable std::atomic<bool> fUnspentIndexStale;
+    void UpdateUnspent(const COutPoint& outpoint, const CTxOut& txout) const;
+    void UpdateUnspentIndex() const;
+    bool IsSpentInMainChain(const COutPoint& outpoint) const;
+
+    //! State of the running ScanForWalletTransactions(), readable without cs_wallet
+    std::atomic<bool> fScanningWallet;
+    std::atomic<bool> fAbortRescan;
+    std::atomic<int64_t> nScanStartTime;
+    std::atomic<double> dScanProgress;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -236,6 +265,11 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockStakingOnly = false;
+        fUnspentIndexStale = true;
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nScanStartTime = 0;
+        dScanProgress = 0;
 
         // Stake Settings
         nHashDrift = 45;
@@ -295,9 +329,11 @@ public:
         return nWalletMaxVersion >= wf;
     }
 
+    //! The unspent output index brought up to date, the coin lists start from it
+    std::set<COutPoint> GetUnspentIndex() const;
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = nullptr, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false, int nWatchonlyConfig = 1) const;
     std::map<CBitcoinAddress, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     /// Get 1000DASH output and keys which can be used for the Masternode
     bool GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash = "", std::string strOutputIndex = "");
@@ -376,6 +412,12 @@ public:
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    //! Make a running ScanForWalletTransactions() stop after the block it is at
+    void AbortRescan() { fAbortRescan = true; }
+    bool IsScanning() const { return fScanningWallet; }
+    //! Milliseconds since the running scan started
+    int64_t ScanningDuration() const { return fScanningWallet ? GetTimeMillis() - nScanStartTime : 0; }
+    double ScanningProgress() const { return fScanningWallet ? (double)dScanProgress : 0; }
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;